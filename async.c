@@ -0,0 +1,113 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Replies awaited without blocking. A handler sends an XCB request and
+ * passes its sequence number with a continuation to async_await(); run()
+ * calls async_dispatch() after every batch of events, which resumes the
+ * continuations whose replies arrived. Replies come in request order, so
+ * dispatching stops at the first one still out. Continuations of a window
+ * are dropped with async_cancel() once it's gone, so they may hold on to
+ * whatever belongs to it. */
+#include <stdlib.h>
+#include <X11/Xlib.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h> /* xcb_poll_for_reply() */
+
+#include "async.h"
+#include "util.h"
+
+typedef struct Await Await;
+struct Await {
+    unsigned int sequence;
+    Window win;
+    void (*func)(void *reply, void *arg);
+    void *arg;
+    int answered; /* reply taken by async_ready() */
+    void *reply;
+    Await *next;
+};
+
+static xcb_connection_t *xc;
+static Await *head, *tail, *spare; /* spare entries are reused */
+
+void async_init(xcb_connection_t *c) { xc = c; }
+
+void async_cleanup() {
+    Await *a;
+
+    async_cancel(None);
+    while ((a = spare)) {
+        spare = a->next;
+        free(a);
+    }
+}
+
+/* Calls func with the reply to free(3) once the request sequence of win is
+ * answered, or with NULL if it failed. */
+void async_await(Window win, unsigned int sequence, void (*func)(void *reply, void *arg), void *arg) {
+    Await *a;
+
+    if ((a = spare))
+        spare = a->next;
+    else
+        a = ecalloc(1, sizeof(Await));
+    a->sequence = sequence;
+    a->win = win;
+    a->func = func;
+    a->arg = arg;
+    a->answered = 0;
+    a->next = NULL;
+    if (tail)
+        tail->next = a;
+    else
+        head = a;
+    tail = a;
+}
+
+/* Drops what's awaited for win, None drops everything. */
+void async_cancel(Window win) {
+    Await **pa = &head, *a;
+
+    tail = NULL;
+    while ((a = *pa)) {
+        if (win != None && a->win != win) {
+            tail = a;
+            pa = &a->next;
+            continue;
+        }
+        *pa = a->next;
+        if (a->answered)
+            free(a->reply);
+        else
+            xcb_discard_reply(xc, a->sequence);
+        a->next = spare;
+        spare = a;
+    }
+}
+
+void async_dispatch() {
+    Await *a;
+
+    while (async_ready()) {
+        /* unlinked first, the continuation may await or cancel */
+        a = head;
+        if (!(head = a->next)) tail = NULL;
+        a->func(a->reply, a->arg);
+        a->next = spare;
+        spare = a;
+    }
+}
+
+int async_pending() { return head != NULL; }
+
+/* Returns whether the first continuation can be resumed, without reading
+ * the connection. Its reply is kept for async_dispatch(), so run() can see
+ * what XCB buffered while dwm wrote or looked for events. */
+int async_ready() {
+    xcb_generic_error_t *e = NULL;
+
+    if (head && !head->answered && xcb_poll_for_reply(xc, head->sequence, &head->reply, &e)) {
+        head->answered = 1;
+        free(e);
+    }
+    return head && head->answered;
+}
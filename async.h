@@ -0,0 +1,10 @@
+/* See LICENSE file for copyright and license details. */
+
+/* Continuations resumed by replies to XCB requests */
+void async_init(xcb_connection_t *c);
+void async_cleanup();
+void async_await(Window win, unsigned int sequence, void (*func)(void *reply, void *arg), void *arg);
+void async_cancel(Window win);
+void async_dispatch();
+int async_pending();
+int async_ready();
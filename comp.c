@@ -0,0 +1,495 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Built-in compositor. Every child of the root window is redirected
+ * manually, its damage is accumulated into one screen region and only that
+ * region is repainted with XRender, once per batch of events. Hidden-tag
+ * clients are skipped and fullscreen clients are unredirected, both on
+ * dwm's word, so no window state is tracked twice. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xrender.h>
+
+#include "comp.h"
+#include "util.h"
+
+#define NSPANS 32
+
+typedef struct CWin CWin;
+struct CWin {
+    Window id;
+    int x, y, w, h, bw;
+    int inputonly, argb;
+    int mapped;
+    int damaged;      /* got its first damage since being mapped */
+    int hidden;       /* on a tag dwm doesn't show */
+    int unredirected; /* drawn by the server, e.g. fullscreen */
+    XRenderPictFormat *format;
+    Damage damage;
+    Pixmap pixmap;
+    Picture picture;
+    CWin *next; /* window below */
+};
+
+static Display *dpy;
+static Window root, cmowner;
+static int screen, sw, sh;
+static CWin *wins; /* top to bottom */
+static Picture rootpicture, buffer, background;
+static Pixmap bufferpixmap;
+static XserverRegion damage; /* accumulated screen damage, None if clean */
+static int damageevent;
+static int damageerror, rendererror; /* first error codes */
+static struct {
+    unsigned long from, to;
+} spans[NSPANS]; /* requests of ours errors may still arrive for */
+static int nspans, depth;
+static unsigned long spanfrom;
+static Atom rootpmap;
+
+/* Brackets the requests of an entry point, so comp_ignoreerror() only
+ * judges errors of the compositor's own requests. Entry points nest. */
+static void begin() {
+    if (!depth++) spanfrom = NextRequest(dpy);
+}
+
+static void end() {
+    unsigned long seen = LastKnownRequestProcessed(dpy), next = NextRequest(dpy);
+    int i, j;
+
+    if (--depth) return;
+    /* errors up to what the server was last heard of are in already */
+    for (i = j = 0; i < nspans; i++)
+        if (spans[i].to > seen + 1) spans[j++] = spans[i];
+    nspans = j;
+    if (next == spanfrom) return;
+    if (nspans && spans[nspans - 1].to == spanfrom) {
+        spans[nspans - 1].to = next;
+        return;
+    }
+    if (nspans == NSPANS) { /* widen rather than forget */
+        spans[1].from = spans[0].from;
+        memmove(spans, spans + 1, --nspans * sizeof *spans);
+    }
+    spans[nspans].from = spanfrom;
+    spans[nspans++].to = next;
+}
+
+static void adddamage(XserverRegion r) {
+    if (!damage)
+        damage = r;
+    else {
+        XFixesUnionRegion(dpy, damage, damage, r);
+        XFixesDestroyRegion(dpy, r);
+    }
+}
+
+static void damagescreen() {
+    XRectangle r = {0, 0, sw, sh};
+
+    adddamage(XFixesCreateRegion(dpy, &r, 1));
+}
+
+static XserverRegion extents(CWin *w) {
+    XRectangle r = {w->x, w->y, w->w + 2 * w->bw, w->h + 2 * w->bw};
+
+    return XFixesCreateRegion(dpy, &r, 1);
+}
+
+static CWin *findwin(Window id) {
+    CWin *w;
+
+    for (w = wins; w && w->id != id; w = w->next)
+        ;
+    return w;
+}
+
+static int painted(CWin *w) { return w->mapped && !w->inputonly && !w->hidden && !w->unredirected; }
+
+static void freepicture(CWin *w) {
+    if (w->picture) XRenderFreePicture(dpy, w->picture);
+    if (w->pixmap) XFreePixmap(dpy, w->pixmap);
+    w->picture = None;
+    w->pixmap = None;
+}
+
+static void freebackground() {
+    if (background) XRenderFreePicture(dpy, background);
+    background = None;
+}
+
+static void freebuffer() {
+    if (buffer) XRenderFreePicture(dpy, buffer);
+    if (bufferpixmap) XFreePixmap(dpy, bufferpixmap);
+    buffer = None;
+    bufferpixmap = None;
+}
+
+/* The root pixmap set by a wallpaper setter, or a solid fill. */
+static Picture getbackground() {
+    Atom type;
+    int format;
+    unsigned long n, after;
+    unsigned char *data = NULL;
+    Pixmap pm = None;
+    XRenderPictureAttributes pa = {.repeat = True};
+    XRenderColor black = {0, 0, 0, 0xffff};
+
+    if (XGetWindowProperty(dpy, root, rootpmap, 0, 1, False, XA_PIXMAP, &type, &format, &n, &after, &data) == Success
+        && data && n)
+        pm = *(Pixmap *)data;
+    if (data) XFree(data);
+    if (pm) return XRenderCreatePicture(dpy, pm, XRenderFindVisualFormat(dpy, DefaultVisual(dpy, screen)), CPRepeat, &pa);
+    return XRenderCreateSolidFill(dpy, &black);
+}
+
+static Picture getpicture(CWin *w) {
+    XRenderPictureAttributes pa = {.subwindow_mode = IncludeInferiors};
+
+    if (!w->picture && w->format) {
+        w->pixmap = XCompositeNameWindowPixmap(dpy, w->id);
+        w->picture = XRenderCreatePicture(dpy, w->pixmap, w->format, CPSubwindowMode, &pa);
+    }
+    return w->picture;
+}
+
+static void mapwin(CWin *w) {
+    w->mapped = 1;
+    w->damaged = 0; /* the first DamageNotify repaints all of it */
+}
+
+static void unmapwin(CWin *w) {
+    if (painted(w)) adddamage(extents(w));
+    w->mapped = 0;
+    freepicture(w);
+}
+
+/* Moves w right above sibling above, to the bottom for None and to the top
+ * for root, which is never a sibling. */
+static void restackwin(CWin *w, Window above) {
+    CWin **wp;
+
+    for (wp = &wins; *wp != w; wp = &(*wp)->next)
+        ;
+    *wp = w->next;
+    if (above == root)
+        wp = &wins;
+    else
+        for (wp = &wins; *wp && (above == None || (*wp)->id != above); wp = &(*wp)->next)
+            ;
+    w->next = *wp;
+    *wp = w;
+}
+
+static void addwin(Window id) {
+    XWindowAttributes wa;
+    CWin *w;
+
+    if (id == cmowner || findwin(id) || !XGetWindowAttributes(dpy, id, &wa)) return;
+    w = ecalloc(1, sizeof(CWin));
+    w->id = id;
+    w->x = wa.x;
+    w->y = wa.y;
+    w->w = wa.width;
+    w->h = wa.height;
+    w->bw = wa.border_width;
+    w->inputonly = wa.class == InputOnly;
+    if (!w->inputonly) {
+        w->format = XRenderFindVisualFormat(dpy, wa.visual);
+        w->argb = w->format && w->format->type == PictTypeDirect && w->format->direct.alphaMask;
+        w->damage = XDamageCreate(dpy, id, XDamageReportNonEmpty);
+        XCompositeRedirectWindow(dpy, id, CompositeRedirectManual);
+    }
+    w->next = wins;
+    wins = w;
+    if (wa.map_state == IsViewable) mapwin(w);
+}
+
+/* gone is set when the window no longer exists, otherwise it only left the
+ * root window and is handed back to the server. */
+static void removewin(CWin *w, int gone) {
+    CWin **wp;
+
+    for (wp = &wins; *wp != w; wp = &(*wp)->next)
+        ;
+    *wp = w->next;
+    unmapwin(w);
+    if (!gone && !w->inputonly) {
+        XDamageDestroy(dpy, w->damage);
+        if (!w->unredirected) XCompositeUnredirectWindow(dpy, w->id, CompositeRedirectManual);
+    }
+    free(w);
+}
+
+static void configurewin(XConfigureEvent *ev) {
+    CWin *w;
+
+    if (ev->window == root) {
+        sw = ev->width;
+        sh = ev->height;
+        freebuffer();
+        damagescreen();
+        return;
+    }
+    if (!(w = findwin(ev->window))) return;
+    if (painted(w)) adddamage(extents(w));
+    if (w->w != ev->width || w->h != ev->height || w->bw != ev->border_width) freepicture(w);
+    w->x = ev->x;
+    w->y = ev->y;
+    w->w = ev->width;
+    w->h = ev->height;
+    w->bw = ev->border_width;
+    restackwin(w, ev->above);
+    if (painted(w)) adddamage(extents(w));
+}
+
+/* Returns the window whose damage ev reports, other Damage objects on the
+ * same window belong to someone else. */
+static CWin *damagedwin(XEvent *ev) {
+    CWin *w;
+
+    if (ev->type != damageevent + XDamageNotify) return NULL;
+    if (!(w = findwin(((XDamageNotifyEvent *)ev)->drawable)) || w->damage != ((XDamageNotifyEvent *)ev)->damage) return NULL;
+    return w;
+}
+
+static void damagewin(CWin *w) {
+    XserverRegion parts;
+
+    if (!w->damaged) {
+        XDamageSubtract(dpy, w->damage, None, None);
+        w->damaged = 1;
+        if (painted(w)) adddamage(extents(w));
+        return;
+    }
+    if (!painted(w)) {
+        /* keep the server reporting, but there is nothing to repaint */
+        XDamageSubtract(dpy, w->damage, None, None);
+        return;
+    }
+    parts = XFixesCreateRegion(dpy, NULL, 0);
+    XDamageSubtract(dpy, w->damage, None, parts);
+    XFixesTranslateRegion(dpy, parts, w->x + w->bw, w->y + w->bw);
+    adddamage(parts);
+}
+
+/* Paints bottom up into the back buffer. */
+static void paintwin(CWin *w) {
+    int ww, wh;
+
+    if (!w) return;
+    paintwin(w->next);
+    ww = w->w + 2 * w->bw;
+    wh = w->h + 2 * w->bw;
+    if (!painted(w) || w->x + ww <= 0 || w->y + wh <= 0 || w->x >= sw || w->y >= sh || !getpicture(w)) return;
+    XRenderComposite(dpy, w->argb ? PictOpOver : PictOpSrc, w->picture, None, buffer, 0, 0, 0, 0, w->x, w->y, ww, wh);
+}
+
+/* Lets windows dwm maps inside its own event loops show up before their
+ * CreateNotify or MapNotify is read. */
+void comp_showwindow(Window win) {
+    CWin *w = findwin(win);
+
+    begin();
+    if (!w)
+        addwin(win);
+    else if (!w->mapped)
+        mapwin(w);
+    end();
+}
+
+int comp_init(Display *d, int s, Window r) {
+    int ev, err, op, major = 0, minor = 2;
+    char name[32];
+    Atom cm;
+    Window dummy, *children;
+    unsigned int i, n;
+    XRenderPictureAttributes pa = {.subwindow_mode = IncludeInferiors};
+
+    dpy = d;
+    screen = s;
+    root = r;
+    sw = DisplayWidth(dpy, screen);
+    sh = DisplayHeight(dpy, screen);
+    if (!XQueryExtension(dpy, COMPOSITE_NAME, &op, &ev, &err) || !XCompositeQueryVersion(dpy, &major, &minor)
+        || (major == 0 && minor < 2) || !XQueryExtension(dpy, "DAMAGE", &op, &damageevent, &damageerror)
+        || !XQueryExtension(dpy, "XFIXES", &op, &ev, &err) || !XQueryExtension(dpy, RENDER_NAME, &op, &ev, &rendererror)) {
+        fprintf(stderr, "dwm: Composite 0.2, Damage, XFixes and Render are needed for compositing\n");
+        return -1;
+    }
+    XDamageQueryExtension(dpy, &damageevent, &damageerror);
+    major = 2;
+    minor = 0;
+    XFixesQueryVersion(dpy, &major, &minor);
+    snprintf(name, sizeof name, "_NET_WM_CM_S%d", screen);
+    cm = XInternAtom(dpy, name, False);
+    if (XGetSelectionOwner(dpy, cm) != None) {
+        fprintf(stderr, "dwm: another compositor is running, not compositing\n");
+        return -1;
+    }
+    begin();
+    cmowner = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
+    XSetSelectionOwner(dpy, cm, cmowner, CurrentTime);
+    rootpmap = XInternAtom(dpy, "_XROOTPMAP_ID", False);
+    rootpicture = XRenderCreatePicture(dpy, root, XRenderFindVisualFormat(dpy, DefaultVisual(dpy, screen)),
+                                       CPSubwindowMode, &pa);
+
+    XGrabServer(dpy);
+    if (XQueryTree(dpy, root, &dummy, &dummy, &children, &n)) {
+        /* bottom to top, so every addwin() ends up on top */
+        for (i = 0; i < n; i++) addwin(children[i]);
+        if (children) XFree(children);
+    }
+    XUngrabServer(dpy);
+    damagescreen();
+    end();
+    return 0;
+}
+
+void comp_cleanup() {
+    begin();
+    while (wins) removewin(wins, 0);
+    freebuffer();
+    freebackground();
+    if (damage) XFixesDestroyRegion(dpy, damage);
+    damage = None;
+    XRenderFreePicture(dpy, rootpicture);
+    XDestroyWindow(dpy, cmowner);
+    end();
+}
+
+/* Returns 1 for events only the compositor cares about, all others are
+ * still dwm's to handle. */
+int comp_event(XEvent *ev) {
+    CWin *w;
+    int mine = 0;
+
+    begin();
+    switch (ev->type) {
+    case CreateNotify:
+        if (ev->xcreatewindow.parent == root) addwin(ev->xcreatewindow.window);
+        break;
+    case ConfigureNotify:
+        configurewin(&ev->xconfigure);
+        break;
+    case DestroyNotify:
+        if ((w = findwin(ev->xdestroywindow.window))) removewin(w, 1);
+        break;
+    case MapNotify:
+        if ((w = findwin(ev->xmap.window))) mapwin(w);
+        break;
+    case UnmapNotify:
+        if ((w = findwin(ev->xunmap.window))) unmapwin(w);
+        break;
+    case ReparentNotify:
+        if (ev->xreparent.parent == root)
+            addwin(ev->xreparent.window);
+        else if ((w = findwin(ev->xreparent.window)))
+            removewin(w, 0);
+        break;
+    case CirculateNotify:
+        if ((w = findwin(ev->xcirculate.window))) {
+            restackwin(w, ev->xcirculate.place == PlaceOnTop ? root : None);
+            if (painted(w)) adddamage(extents(w));
+        }
+        break;
+    case PropertyNotify:
+        if (ev->xproperty.window == root && ev->xproperty.atom == rootpmap) {
+            freebackground();
+            damagescreen();
+        }
+        break;
+    default:
+        if ((w = damagedwin(ev))) {
+            damagewin(w);
+            mine = 1;
+        }
+    }
+    end();
+    return mine;
+}
+
+/* Errors of our requests on windows, pixmaps, pictures and damage that
+ * vanished under us are expected, any other error is still dwm's. */
+int comp_ignoreerror(XErrorEvent *ee) {
+    int i, ours = depth && ee->serial >= spanfrom;
+
+    for (i = 0; i < nspans && !ours; i++) ours = ee->serial >= spans[i].from && ee->serial < spans[i].to;
+    return ours
+           && (ee->error_code == BadWindow || ee->error_code == BadDrawable || ee->error_code == BadPixmap || ee->error_code == BadMatch
+               || ee->error_code == damageerror + BadDamage || ee->error_code == rendererror + BadPicture);
+}
+
+void comp_paint() {
+    CWin *w;
+    XserverRegion r;
+
+    if (!damage) return;
+    begin();
+    if (!buffer) {
+        bufferpixmap = XCreatePixmap(dpy, root, sw, sh, DefaultDepth(dpy, screen));
+        buffer = XRenderCreatePicture(dpy, bufferpixmap, XRenderFindVisualFormat(dpy, DefaultVisual(dpy, screen)), 0,
+                                      NULL);
+    }
+    if (!background) background = getbackground();
+    XFixesSetPictureClipRegion(dpy, buffer, 0, 0, damage);
+    XRenderComposite(dpy, PictOpSrc, background, None, buffer, 0, 0, 0, 0, 0, 0, sw, sh);
+    paintwin(wins);
+    /* leave what unredirected windows draw themselves alone */
+    for (w = wins; w; w = w->next)
+        if (w->mapped && w->unredirected) {
+            r = extents(w);
+            XFixesSubtractRegion(dpy, damage, damage, r);
+            XFixesDestroyRegion(dpy, r);
+        }
+    XFixesSetPictureClipRegion(dpy, rootpicture, 0, 0, damage);
+    XRenderComposite(dpy, PictOpSrc, buffer, None, rootpicture, 0, 0, 0, 0, 0, 0, sw, sh);
+    XFixesDestroyRegion(dpy, damage);
+    damage = None;
+    end();
+}
+
+void comp_setredirect(Window win, int redirect) {
+    CWin *w = findwin(win);
+
+    if (!w || w->inputonly || w->unredirected == !redirect) return;
+    begin();
+    if (redirect)
+        XCompositeRedirectWindow(dpy, win, CompositeRedirectManual);
+    else
+        XCompositeUnredirectWindow(dpy, win, CompositeRedirectManual);
+    w->unredirected = !redirect;
+    freepicture(w);
+    if (w->mapped) adddamage(extents(w));
+    end();
+}
+
+void comp_setvisible(Window win, int visible) {
+    CWin *w = findwin(win);
+
+    if (!w || w->hidden == !visible) return;
+    begin();
+    w->hidden = !visible;
+    if (w->mapped) adddamage(extents(w));
+    end();
+}
+
+/* Handles damage and geometry changes that arrived while dwm reads only
+ * input, as in the move and resize loops, and repaints. */
+static Bool syncevent(Display *d, XEvent *ev, XPointer arg) {
+    return damagedwin(ev) || (ev->type == ConfigureNotify && ev->xconfigure.window != root);
+}
+
+void comp_sync() {
+    XEvent ev;
+
+    begin();
+    while (XCheckIfEvent(dpy, &ev, syncevent, NULL)) comp_event(&ev);
+    comp_paint();
+    end();
+}
@@ -0,0 +1,12 @@
+/* See LICENSE file for copyright and license details. */
+
+/* Built-in compositor, only compiled with -DCOMPOSITOR */
+int comp_init(Display *dpy, int screen, Window root);
+void comp_cleanup();
+int comp_event(XEvent *ev);
+int comp_ignoreerror(XErrorEvent *ee);
+void comp_paint();
+void comp_setredirect(Window win, int redirect);
+void comp_showwindow(Window win);
+void comp_setvisible(Window win, int visible);
+void comp_sync();
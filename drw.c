@@ -1,15 +1,26 @@
 /* See LICENSE file for copyright and license details. */
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <X11/Xlib.h>
 #include <X11/Xft/Xft.h>
+#include <fontconfig/fcfreetype.h>
 
 #include "drw.h"
 #include "util.h"
 
 #define UTF_INVALID 0xFFFD
 #define UTF_SIZ 4
+#define GLYPH_MAX 1024 /* glyphs resolved per drw_text call */
+#define FCACHE_MAGIC "dwmfc02"
+#define ATLAS_W 512
+#define ATLAS_H 512
+#define ATLAS_GLYPHS 1024 /* slots of the atlas glyph table */
 
 static const unsigned char utfbyte[UTF_SIZ + 1] = {0x80, 0, 0xC0, 0xE0, 0xF0};
 static const unsigned char utfmask[UTF_SIZ + 1] = {0xC0, 0x80, 0xE0, 0xF0, 0xF8};
@@ -48,6 +59,71 @@ static size_t utf8decode(const char *c, long *u, size_t clen) {
     return len;
 }
 
+/* On-disk layout of the font coverage cache: a header, ranges sorted by
+ * lo and a string table of font file names, all read through mmap(2). */
+typedef struct {
+    char magic[8];
+    uint32_t key;   /* hash of the primary font name */
+    uint32_t nranges;
+    int64_t stamp;  /* newest mtime of the fontconfig cache directories */
+    uint32_t strsize;
+    uint32_t pad;
+} FcacheHeader;
+
+typedef struct {
+    uint32_t lo, hi; /* codepoints covered */
+    uint32_t file;   /* offset into the string table */
+    int32_t index;   /* face index within file */
+    uint32_t color;  /* drawn through the glyph atlas */
+} FcacheRange;
+
+typedef struct {
+    uint32_t lo, hi;
+    char *file;
+    int index;
+    int color;
+} FcacheEntry;
+
+struct FontCache {
+    char *path;
+    uint32_t key;
+    int64_t stamp;
+    void *map; /* valid cache file, or NULL */
+    size_t maplen;
+    const FcacheRange *ranges;
+    uint32_t nranges;
+    const char *strs;
+    uint32_t strsize;
+    FcacheEntry *learned; /* ranges found since the file was loaded */
+    size_t nlearned;
+    size_t nsaved; /* learned ranges already written */
+};
+
+typedef struct {
+    Fnt *font;
+    FT_UInt glyph;
+    short x, y, w, h;   /* position in the atlas */
+    short left, top;    /* bearing relative to the pen */
+    unsigned short advance;
+} AtlasGlyph;
+
+/* Color glyphs are rasterized once into an ARGB pixmap; later draws are a
+ * single XRenderComposite from it. The whole atlas is reset when full, an
+ * entry is only valid in the generation it was made in. */
+struct Atlas {
+    Pixmap pixmap;
+    Picture picture;
+    GC gc;
+    int x, y, rowh; /* shelf packing cursor */
+    AtlasGlyph glyphs[ATLAS_GLYPHS];
+    int nglyphs;
+    unsigned int generation; /* resets so far */
+};
+
+static FT_Library ftlib;
+
+static void fcache_free(FontCache *fc);
+
 Drw *drw_create(Display *dpy, int screen, Window root, unsigned int w, unsigned int h) {
     Drw *drw = ecalloc(1, sizeof(Drw));
 
@@ -57,6 +133,7 @@ Drw *drw_create(Display *dpy, int screen, Window root, unsigned int w, unsigned
     drw->w = w;
     drw->h = h;
     drw->drawable = XCreatePixmap(dpy, root, w, h, DefaultDepth(dpy, screen));
+    drw->xftdraw = XftDrawCreate(dpy, drw->drawable, DefaultVisual(dpy, screen), DefaultColormap(dpy, screen));
     drw->gc = XCreateGC(dpy, root, 0, NULL);
     XSetLineAttributes(dpy, drw->gc, 1, LineSolid, CapButt, JoinMiter);
 
@@ -68,12 +145,66 @@ void drw_resize(Drw *drw, unsigned int w, unsigned int h) {
 
     drw->w = w;
     drw->h = h;
+    if (drw->xftdraw) XftDrawDestroy(drw->xftdraw);
+    if (drw->picture) XRenderFreePicture(drw->dpy, drw->picture);
+    drw->picture = None;
     if (drw->drawable) XFreePixmap(drw->dpy, drw->drawable);
     drw->drawable = XCreatePixmap(drw->dpy, drw->root, w, h, DefaultDepth(drw->dpy, drw->screen));
+    drw->xftdraw = XftDrawCreate(drw->dpy, drw->drawable, DefaultVisual(drw->dpy, drw->screen), DefaultColormap(drw->dpy, drw->screen));
+    drw->ndamage = 0;
+}
+
+/* Records x, y, w, h as dirty. Overlapping or touching rectangles are
+ * merged; once the list is full the rectangle is merged into the entry
+ * whose bounding box grows the least. */
+static void drw_damage(Drw *drw, int x, int y, unsigned int w, unsigned int h) {
+    XRectangle *r;
+    int i, best = 0, x2, y2;
+    long grow, mingrow = -1;
+
+    if (!w || !h) return;
+    for (i = 0; i < drw->ndamage; i++) {
+        r = &drw->damage[i];
+        x2 = MAX(r->x + r->width, x + (int)w);
+        y2 = MAX(r->y + r->height, y + (int)h);
+        grow = (long)(x2 - MIN(r->x, x)) * (y2 - MIN(r->y, y)) - (long)r->width * r->height;
+        if (x <= r->x + r->width && r->x <= x + (int)w && y <= r->y + r->height && r->y <= y + (int)h) {
+            best = i;
+            break;
+        }
+        if (mingrow < 0 || grow < mingrow) {
+            mingrow = grow;
+            best = i;
+        }
+    }
+    if (i == drw->ndamage && drw->ndamage < DAMAGE_MAX) {
+        r = &drw->damage[drw->ndamage++];
+        r->x = x;
+        r->y = y;
+        r->width = w;
+        r->height = h;
+        return;
+    }
+    r = &drw->damage[best];
+    x2 = MAX(r->x + r->width, x + (int)w);
+    y2 = MAX(r->y + r->height, y + (int)h);
+    r->x = MIN(r->x, x);
+    r->y = MIN(r->y, y);
+    r->width = x2 - r->x;
+    r->height = y2 - r->y;
 }
 
 void drw_free(Drw *drw) {
+    XftDrawDestroy(drw->xftdraw);
+    if (drw->picture) XRenderFreePicture(drw->dpy, drw->picture);
     XFreePixmap(drw->dpy, drw->drawable);
+    if (drw->atlas) {
+        XRenderFreePicture(drw->dpy, drw->atlas->picture);
+        XFreeGC(drw->dpy, drw->atlas->gc);
+        XFreePixmap(drw->dpy, drw->atlas->pixmap);
+        free(drw->atlas);
+    }
+    fcache_free(drw->fcache);
     XFreeGC(drw->dpy, drw->gc);
     drw_fontset_free(drw->fonts);
     free(drw);
@@ -136,7 +267,10 @@ static Fnt *xfont_create(Drw *drw, const char *fontname, FcPattern *fontpattern)
 static void xfont_free(Fnt *font) {
     if (!font) return;
     if (font->pattern) FcPatternDestroy(font->pattern);
-    XftFontClose(font->dpy, font->xfont);
+    if (font->face)
+        FT_Done_Face(font->face);
+    else
+        XftFontClose(font->dpy, font->xfont);
     free(font);
 }
 
@@ -190,30 +324,471 @@ void drw_setscheme(Drw *drw, Clr *scm) {
     if (drw) drw->scheme = scm;
 }
 
+/* The XRender view of drw->drawable, created on first use */
+static Picture drw_renderpicture(Drw *drw) {
+    if (!drw->picture)
+        drw->picture = XRenderCreatePicture(drw->dpy, drw->drawable, XRenderFindVisualFormat(drw->dpy, DefaultVisual(drw->dpy, drw->screen)),
+                                            0, NULL);
+    return drw->picture;
+}
+
+void drw_picture(Drw *drw, Picture src, int x, int y, unsigned int w, unsigned int h) {
+    if (!drw || !src) return;
+    drw_damage(drw, x, y, w, h);
+    XRenderComposite(drw->dpy, PictOpOver, src, None, drw_renderpicture(drw), 0, 0, 0, 0, x, y, w, h);
+}
+
 void drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int invert) {
     if (!drw || !drw->scheme) return;
     XSetForeground(drw->dpy, drw->gc, invert ? drw->scheme[ColBg].pixel : drw->scheme[ColFg].pixel);
+    drw_damage(drw, x, y, w, h);
     if (filled)
         XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
     else
         XDrawRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w - 1, h - 1);
 }
 
-int drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lpad, const char *text, int invert) {
-    char buf[1024];
-    int ty;
-    unsigned int ew;
-    XftDraw *d = NULL;
-    Fnt *usedfont, *curfont, *nextfont;
-    size_t i, len;
-    int utf8strlen, utf8charlen, render = x || y || w || h;
-    long utf8codepoint = 0;
-    const char *utf8str;
+/* Pixel size color glyphs are scaled to, the one of the primary font */
+static double colorfont_px(Drw *drw) {
+    double px;
+
+    if (FcPatternGetDouble(drw->fonts->xfont->pattern, FC_PIXEL_SIZE, 0, &px) != FcResultMatch) px = drw->fonts->h;
+    return px;
+}
+
+static Fnt *colorfont_create(Drw *drw, const char *file, int index) {
+    FT_Face face;
+    Fnt *font;
+    double px = colorfont_px(drw), cur, cand;
+    int i, best = 0;
+
+    if (!ftlib && FT_Init_FreeType(&ftlib)) return NULL;
+    if (FT_New_Face(ftlib, file, index, &face)) return NULL;
+    if (!FT_HAS_COLOR(face)) {
+        FT_Done_Face(face);
+        return NULL;
+    }
+    if (FT_IS_SCALABLE(face)) {
+        FT_Set_Pixel_Sizes(face, 0, px + 0.5);
+    } else {
+        /* bitmap strikes (Noto Color Emoji): pick the smallest one at least
+         * as big as the text, it is scaled down once when rasterized */
+        for (i = 1; i < face->num_fixed_sizes; i++) {
+            cur = face->available_sizes[best].y_ppem / 64.0;
+            cand = face->available_sizes[i].y_ppem / 64.0;
+            if (cur < px ? cand > cur : cand >= px && cand < cur) best = i;
+        }
+        if (!face->num_fixed_sizes || FT_Select_Size(face, best)) {
+            FT_Done_Face(face);
+            return NULL;
+        }
+    }
+    font = ecalloc(1, sizeof(Fnt));
+    font->face = face;
+    font->h = drw->fonts->h;
+    font->dpy = drw->dpy;
+    return font;
+}
+
+/* Returns the atlas entry of glyph, rasterizing it with FreeType and
+ * uploading it on first use. */
+static AtlasGlyph *atlas_glyph(Drw *drw, Fnt *font, FT_UInt glyph) {
+    Atlas *a = drw->atlas;
+    AtlasGlyph *g;
+    FT_GlyphSlot slot;
+    XImage *img;
+    uint32_t *pixels, sum[4];
+    unsigned char *src;
+    double scale;
+    int i, slotn, dx, dy, sx, sy, sx0, sx1, sy0, sy1, n, w, h, bw, bh;
+
+    if (!a) {
+        a = drw->atlas = ecalloc(1, sizeof(Atlas));
+        a->pixmap = XCreatePixmap(drw->dpy, drw->root, ATLAS_W, ATLAS_H, 32);
+        a->gc = XCreateGC(drw->dpy, a->pixmap, 0, NULL);
+        a->picture = XRenderCreatePicture(drw->dpy, a->pixmap, XRenderFindStandardFormat(drw->dpy, PictStandardARGB32), 0, NULL);
+    }
+    slotn = ((uintptr_t)font / sizeof(Fnt) * 31 + glyph) % ATLAS_GLYPHS;
+    for (i = 0; i < ATLAS_GLYPHS; i++, slotn = (slotn + 1) % ATLAS_GLYPHS) {
+        g = &a->glyphs[slotn];
+        if (g->font == font && g->glyph == glyph) return g;
+        if (!g->font) break;
+    }
+
+    if (FT_Load_Glyph(font->face, glyph, FT_LOAD_COLOR) || FT_Render_Glyph(font->face->glyph, FT_RENDER_MODE_NORMAL)) return NULL;
+    slot = font->face->glyph;
+    if (slot->bitmap.pixel_mode != FT_PIXEL_MODE_BGRA) return NULL;
+    scale = colorfont_px(drw) / (font->face->size->metrics.y_ppem ? font->face->size->metrics.y_ppem : 1);
+    if (scale > 1) scale = 1;
+    bw = slot->bitmap.width;
+    bh = slot->bitmap.rows;
+    w = MAX(1, bw * scale + 0.5);
+    h = MAX(1, bh * scale + 0.5);
+    if (w > ATLAS_W || h > ATLAS_H) return NULL;
+
+    /* start over once the table or the pixmap is full */
+    if (a->x + w > ATLAS_W) {
+        a->x = 0;
+        a->y += a->rowh;
+        a->rowh = 0;
+    }
+    if (a->y + h > ATLAS_H || a->nglyphs >= ATLAS_GLYPHS / 2) {
+        memset(a->glyphs, 0, sizeof a->glyphs);
+        a->nglyphs = a->x = a->y = a->rowh = 0;
+        a->generation++;
+        slotn = ((uintptr_t)font / sizeof(Fnt) * 31 + glyph) % ATLAS_GLYPHS;
+    }
+
+    /* box filter the premultiplied BGRA bitmap down to the text size */
+    pixels = ecalloc(w * h, sizeof(uint32_t));
+    for (dy = 0; dy < h; dy++) {
+        sy0 = dy * bh / h;
+        sy1 = MAX(sy0 + 1, (dy + 1) * bh / h);
+        for (dx = 0; dx < w; dx++) {
+            sx0 = dx * bw / w;
+            sx1 = MAX(sx0 + 1, (dx + 1) * bw / w);
+            memset(sum, 0, sizeof sum);
+            for (sy = sy0; sy < sy1; sy++) {
+                src = slot->bitmap.buffer + sy * slot->bitmap.pitch + sx0 * 4;
+                for (sx = sx0; sx < sx1; sx++, src += 4)
+                    for (i = 0; i < 4; i++) sum[i] += src[i];
+            }
+            n = (sx1 - sx0) * (sy1 - sy0);
+            pixels[dy * w + dx] = (sum[3] / n) << 24 | (sum[2] / n) << 16 | (sum[1] / n) << 8 | sum[0] / n;
+        }
+    }
+    img = XCreateImage(drw->dpy, DefaultVisual(drw->dpy, drw->screen), 32, ZPixmap, 0, (char *)pixels, w, h, 32, 0);
+    img->byte_order = *(const unsigned char *)&(const uint32_t){1} ? LSBFirst : MSBFirst; /* host order */
+    XPutImage(drw->dpy, a->pixmap, a->gc, img, 0, 0, a->x, a->y, w, h);
+    XDestroyImage(img); /* frees pixels */
+
+    g = &a->glyphs[slotn];
+    g->font = font;
+    g->glyph = glyph;
+    g->x = a->x;
+    g->y = a->y;
+    g->w = w;
+    g->h = h;
+    g->left = slot->bitmap_left * scale;
+    g->top = slot->bitmap_top * scale;
+    g->advance = (slot->advance.x >> 6) * scale + 0.5;
+    a->x += w;
+    a->rowh = MAX(a->rowh, h);
+    a->nglyphs++;
+    return g;
+}
+
+static uint32_t fcache_key(Drw *drw) {
+    FcChar8 *name = FcNameUnparse(drw->fonts->pattern);
+    uint32_t h = 2166136261u; /* FNV-1a */
+    FcChar8 *p;
+
+    for (p = name; p && *p; p++) h = (h ^ *p) * 16777619u;
+    free(name);
+    return h;
+}
+
+static int64_t fcache_stamp() {
+    FcStrList *dirs = FcConfigGetCacheDirs(NULL);
+    FcChar8 *dir;
+    struct stat st;
+    int64_t stamp = 0;
+
+    if (!dirs) return 0;
+    while ((dir = FcStrListNext(dirs)))
+        if (stat((const char *)dir, &st) == 0 && st.st_mtime > stamp) stamp = st.st_mtime;
+    FcStrListDone(dirs);
+    return stamp;
+}
+
+void drw_fontcache_load(Drw *drw, const char *path) {
+    FontCache *fc;
+    const FcacheHeader *hdr;
+    struct stat st;
+    int fd;
+
+    if (!drw || !drw->fonts || !drw->fonts->pattern || !path) return;
+    fc = ecalloc(1, sizeof(FontCache));
+    fc->path = strdup(path);
+    fc->key = fcache_key(drw);
+    fc->stamp = fcache_stamp();
+    drw->fcache = fc;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) return;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(FcacheHeader))
+        fc->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (!fc->map || fc->map == MAP_FAILED) {
+        fc->map = NULL;
+        return;
+    }
+    fc->maplen = st.st_size;
+    hdr = fc->map;
+    /* fonts were installed or removed, or the primary font changed */
+    if (memcmp(hdr->magic, FCACHE_MAGIC, sizeof hdr->magic) || hdr->key != fc->key || hdr->stamp != fc->stamp
+        || sizeof(FcacheHeader) + (uint64_t)hdr->nranges * sizeof(FcacheRange) + hdr->strsize != fc->maplen) {
+        munmap(fc->map, fc->maplen);
+        fc->map = NULL;
+        return;
+    }
+    fc->ranges = (const FcacheRange *)(hdr + 1);
+    fc->nranges = hdr->nranges;
+    fc->strs = (const char *)(fc->ranges + fc->nranges);
+    fc->strsize = hdr->strsize;
+}
+
+static int fcache_cmp(const void *a, const void *b) {
+    const FcacheEntry *x = a, *y = b;
+
+    return x->lo < y->lo ? -1 : x->lo > y->lo;
+}
+
+/* Rewrites the cache file from the loaded ranges and the learned ones. */
+void drw_fontcache_save(Drw *drw) {
+    FontCache *fc;
+    FcacheHeader hdr = {FCACHE_MAGIC, 0, 0, 0, 0, 0};
+    FcacheEntry *all;
+    FcacheRange *ranges;
+    char *strs, *tmp;
+    size_t i, j, n = 0, strsize = 0, len;
+    FILE *f;
+
+    if (!drw || !(fc = drw->fcache) || fc->nlearned == fc->nsaved) return;
+    all = ecalloc(fc->nranges + fc->nlearned, sizeof(FcacheEntry));
+    for (i = 0; i < fc->nlearned; i++) all[n++] = fc->learned[i];
+    /* ranges whose font turned out to be gone were learned again */
+    for (i = 0; i < fc->nranges; i++) {
+        for (j = 0; j < fc->nlearned && (fc->ranges[i].hi < fc->learned[j].lo || fc->ranges[i].lo > fc->learned[j].hi); j++)
+            ;
+        if (j == fc->nlearned && fc->ranges[i].file < fc->strsize) {
+            all[n].lo = fc->ranges[i].lo;
+            all[n].hi = fc->ranges[i].hi;
+            all[n].file = (char *)fc->strs + fc->ranges[i].file;
+            all[n].color = fc->ranges[i].color;
+            all[n++].index = fc->ranges[i].index;
+        }
+    }
+    qsort(all, n, sizeof(FcacheEntry), fcache_cmp);
+
+    ranges = ecalloc(n, sizeof(FcacheRange));
+    strs = NULL;
+    for (i = 0; i < n; i++) {
+        /* share the names of fonts covering several ranges */
+        for (j = 0; j < i && strcmp(all[j].file, all[i].file); j++)
+            ;
+        if (j < i) {
+            ranges[i].file = ranges[j].file;
+        } else {
+            len = strlen(all[i].file) + 1;
+            if (!(strs = realloc(strs, strsize + len))) die("realloc:");
+            memcpy(strs + strsize, all[i].file, len);
+            ranges[i].file = strsize;
+            strsize += len;
+        }
+        ranges[i].lo = all[i].lo;
+        ranges[i].hi = all[i].hi;
+        ranges[i].index = all[i].index;
+        ranges[i].color = all[i].color;
+    }
+    hdr.key = fc->key;
+    hdr.stamp = fc->stamp;
+    hdr.nranges = n;
+    hdr.strsize = strsize;
+
+    /* write and rename so a running dwm never maps a partial file */
+    tmp = ecalloc(strlen(fc->path) + 5, 1);
+    sprintf(tmp, "%s.tmp", fc->path);
+    if ((f = fopen(tmp, "w"))) {
+        if (fwrite(&hdr, sizeof hdr, 1, f) == 1 && fwrite(ranges, sizeof(FcacheRange), n, f) == n
+            && fwrite(strs, 1, strsize, f) == strsize && fclose(f) == 0 && rename(tmp, fc->path) == 0)
+            fc->nsaved = fc->nlearned;
+        else
+            unlink(tmp);
+    }
+    free(tmp);
+    free(strs);
+    free(ranges);
+    free(all);
+}
+
+static void fcache_free(FontCache *fc) {
+    size_t i;
+
+    if (!fc) return;
+    if (fc->map) munmap(fc->map, fc->maplen);
+    for (i = 0; i < fc->nlearned; i++) free(fc->learned[i].file);
+    free(fc->learned);
+    free(fc->path);
+    free(fc);
+}
+
+/* Opens the font the cache file recorded for codepoint without asking
+ * fontconfig to match against every installed font. */
+static Fnt *fcache_open(Drw *drw, long codepoint) {
+    FontCache *fc = drw->fcache;
+    const char *file = NULL;
+    FcPattern *request, *fontpat, *match;
+    size_t i, lo, hi, mid;
+    int index = 0, color = 0;
+
+    if (!fc) return NULL;
+    for (i = 0; i < fc->nlearned; i++)
+        if (fc->learned[i].lo <= codepoint && codepoint <= fc->learned[i].hi) return NULL; /* already loaded */
+    for (lo = 0, hi = fc->nranges; lo < hi;) {
+        mid = (lo + hi) / 2;
+        if (fc->ranges[mid].hi < codepoint) {
+            lo = mid + 1;
+        } else if (fc->ranges[mid].lo > codepoint) {
+            hi = mid;
+        } else {
+            if (fc->ranges[mid].file < fc->strsize) file = fc->strs + fc->ranges[mid].file;
+            index = fc->ranges[mid].index;
+            color = fc->ranges[mid].color;
+            break;
+        }
+    }
+    if (!file) return NULL;
+    if (color) return colorfont_create(drw, file, index);
+    if (!(fontpat = FcFreeTypeQuery((const FcChar8 *)file, index, NULL, NULL))) return NULL;
+
+    request = FcPatternDuplicate(drw->fonts->pattern);
+    FcPatternAddBool(request, FC_SCALABLE, FcTrue);
+    FcConfigSubstitute(NULL, request, FcMatchPattern);
+    XftDefaultSubstitute(drw->dpy, drw->screen, request);
+    match = FcFontRenderPrepare(NULL, request, fontpat);
+    FcPatternDestroy(request);
+    FcPatternDestroy(fontpat);
+    return match ? xfont_create(drw, NULL, match) : NULL;
+}
+
+/* Remembers the contiguous run of codepoints around codepoint, within its
+ * 256 codepoint page, that the font described by pattern covers. */
+static void fcache_learn(Drw *drw, FcPattern *pattern, long codepoint, int color) {
+    FontCache *fc = drw->fcache;
+    FcacheEntry *e;
+    FcCharSet *cs;
+    FcChar8 *file;
+    int index = 0;
+    long lo, hi;
+
+    if (!fc || FcPatternGetString(pattern, FC_FILE, 0, &file) != FcResultMatch
+        || FcPatternGetCharSet(pattern, FC_CHARSET, 0, &cs) != FcResultMatch)
+        return;
+    FcPatternGetInteger(pattern, FC_INDEX, 0, &index);
+    for (lo = codepoint; lo & 0xFF && FcCharSetHasChar(cs, lo - 1); lo--)
+        ;
+    for (hi = codepoint; (hi + 1) & 0xFF && FcCharSetHasChar(cs, hi + 1); hi++)
+        ;
+    if (!(fc->learned = realloc(fc->learned, (fc->nlearned + 1) * sizeof(FcacheEntry)))) die("realloc:");
+    e = &fc->learned[fc->nlearned++];
+    e->lo = lo;
+    e->hi = hi;
+    e->file = strdup((const char *)file);
+    e->index = index;
+    e->color = color;
+}
+
+static int font_has(Drw *drw, Fnt *font, long codepoint) {
+    return font->face ? FT_Get_Char_Index(font->face, codepoint) != 0 : XftCharExists(drw->dpy, font->xfont, codepoint);
+}
+
+static FcPattern *fallback_match(Drw *drw, long codepoint, FcBool color) {
     FcCharSet *fccharset;
     FcPattern *fcpattern;
     FcPattern *match;
     XftResult result;
-    int charexists = 0;
+
+    fccharset = FcCharSetCreate();
+    FcCharSetAddChar(fccharset, codepoint);
+
+    fcpattern = FcPatternDuplicate(drw->fonts->pattern);
+    FcPatternAddCharSet(fcpattern, FC_CHARSET, fccharset);
+    FcPatternAddBool(fcpattern, FC_SCALABLE, FcTrue);
+    FcPatternAddBool(fcpattern, FC_COLOR, color);
+
+    FcConfigSubstitute(NULL, fcpattern, FcMatchPattern);
+    FcDefaultSubstitute(fcpattern);
+    match = XftFontMatch(drw->dpy, drw->screen, fcpattern, &result);
+
+    FcCharSetDestroy(fccharset);
+    FcPatternDestroy(fcpattern);
+    return match;
+}
+
+/* Returns the first font of the set able to draw codepoint, loading a
+ * fontconfig fallback font into the set if none of them is. Color fonts
+ * are tried last, Xft can't draw them so they go through the atlas. */
+static Fnt *xfont_lookup(Drw *drw, long codepoint) {
+    Fnt *curfont, *usedfont;
+    FcPattern *match;
+    FcChar8 *file;
+    FcBool iscol;
+    int index = 0;
+
+    for (curfont = drw->fonts; curfont; curfont = curfont->next)
+        if (font_has(drw, curfont, codepoint)) return curfont;
+
+    if (!drw->fonts->pattern) {
+        /* Refer to the comment in xfont_create for more information. */
+        die("the first font in the cache must be loaded from a font string.");
+    }
+
+    if ((usedfont = fcache_open(drw, codepoint))) {
+        if (font_has(drw, usedfont, codepoint)) goto found;
+        xfont_free(usedfont);
+    }
+
+    if ((match = fallback_match(drw, codepoint, FcFalse))) {
+        usedfont = xfont_create(drw, NULL, match);
+        if (usedfont && XftCharExists(drw->dpy, usedfont->xfont, codepoint)) {
+            fcache_learn(drw, usedfont->xfont->pattern, codepoint, 0);
+            goto found;
+        }
+        xfont_free(usedfont);
+    }
+
+    if ((match = fallback_match(drw, codepoint, FcTrue))) {
+        usedfont = NULL;
+        if (FcPatternGetBool(match, FC_COLOR, 0, &iscol) == FcResultMatch && iscol
+            && FcPatternGetString(match, FC_FILE, 0, &file) == FcResultMatch) {
+            FcPatternGetInteger(match, FC_INDEX, 0, &index);
+            if ((usedfont = colorfont_create(drw, (const char *)file, index)) && font_has(drw, usedfont, codepoint))
+                fcache_learn(drw, match, codepoint, 1);
+            else {
+                xfont_free(usedfont);
+                usedfont = NULL;
+            }
+        }
+        FcPatternDestroy(match);
+        if (usedfont) goto found;
+    }
+
+    /* Regardless of whether or not a fallback font is found, the
+     * character must be drawn. */
+    return drw->fonts;
+found:
+    for (curfont = drw->fonts; curfont->next; curfont = curfont->next)
+        ; /* NOP */
+    curfont->next = usedfont;
+    return usedfont;
+}
+
+/* Every glyph is resolved to a font and glyph index exactly once and the
+ * whole string goes out as a single XftDrawGlyphFontSpec request. */
+int drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lpad, const char *text, int invert) {
+    XftGlyphFontSpec specs[GLYPH_MAX];
+    unsigned int advance[GLYPH_MAX];
+    Fnt *usedfont[GLYPH_MAX];
+    int colorslot[GLYPH_MAX]; /* in the atlas, or -1 */
+    unsigned int colorgen[GLYPH_MAX];
+    AtlasGlyph *g;
+    Fnt *dotfont;
+    XGlyphInfo ext;
+    FT_UInt dot;
+    size_t i, j, n, len;
+    unsigned int ew, dotw;
+    int render = x || y || w || h, ty;
+    long utf8codepoint = 0;
 
     if (!drw || (render && !drw->scheme) || !text || !drw->fonts) return 0;
 
@@ -222,111 +797,94 @@ int drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned in
     } else {
         XSetForeground(drw->dpy, drw->gc, drw->scheme[invert ? ColFg : ColBg].pixel);
         XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
-        d = XftDrawCreate(drw->dpy, drw->drawable, DefaultVisual(drw->dpy, drw->screen), DefaultColormap(drw->dpy, drw->screen));
+        drw_damage(drw, x, y, w, h);
         x += lpad;
         w -= lpad;
     }
 
-    usedfont = drw->fonts;
-    while (1) {
-        utf8strlen = 0;
-        utf8str = text;
-        nextfont = NULL;
-        while (*text) {
-            utf8charlen = utf8decode(text, &utf8codepoint, UTF_SIZ);
-            for (curfont = drw->fonts; curfont; curfont = curfont->next) {
-                charexists = charexists || XftCharExists(drw->dpy, curfont->xfont, utf8codepoint);
-                if (charexists) {
-                    if (curfont == usedfont) {
-                        utf8strlen += utf8charlen;
-                        text += utf8charlen;
-                    } else {
-                        nextfont = curfont;
-                    }
-                    break;
-                }
-            }
-
-            if (!charexists || nextfont)
-                break;
-            else
-                charexists = 0;
+    for (n = 0, ew = 0; *text && n < GLYPH_MAX; n++, text += len) {
+        if (!(len = utf8decode(text, &utf8codepoint, UTF_SIZ))) len = 1;
+        usedfont[n] = xfont_lookup(drw, utf8codepoint);
+        specs[n].font = usedfont[n]->xfont;
+        if (usedfont[n]->face) {
+            specs[n].glyph = FT_Get_Char_Index(usedfont[n]->face, utf8codepoint);
+            /* kept by slot, a reset later in the string clears the entry */
+            g = atlas_glyph(drw, usedfont[n], specs[n].glyph);
+            colorslot[n] = g ? g - drw->atlas->glyphs : -1;
+            colorgen[n] = g ? drw->atlas->generation : 0;
+            advance[n] = g ? g->advance : 0;
+        } else {
+            specs[n].glyph = XftCharIndex(drw->dpy, usedfont[n]->xfont, utf8codepoint);
+            XftGlyphExtents(drw->dpy, usedfont[n]->xfont, &specs[n].glyph, 1, &ext);
+            advance[n] = ext.xOff;
         }
+        ew += advance[n];
+    }
 
-        if (utf8strlen) {
-            drw_font_getexts(usedfont, utf8str, utf8strlen, &ew, NULL);
-            /* shorten text if necessary */
-            for (len = MIN(utf8strlen, sizeof(buf) - 1); len && ew > w; len--) drw_font_getexts(usedfont, utf8str, len, &ew, NULL);
-
-            if (len) {
-                memcpy(buf, utf8str, len);
-                buf[len] = '\0';
-                if (len < utf8strlen)
-                    for (i = len; i && i > len - 3; buf[--i] = '.')
-                        ; /* NOP */
-
-                if (render) {
-                    ty = y + (h - usedfont->h) / 2 + usedfont->xfont->ascent;
-                    XftDrawStringUtf8(d, &drw->scheme[invert ? ColBg : ColFg], usedfont->xfont, x, ty, (XftChar8 *)buf, len);
-                }
-                x += ew;
-                w -= ew;
-            }
+    /* shorten text if necessary */
+    if (ew > w || *text) {
+        dotfont = xfont_lookup(drw, '.');
+        dot = XftCharIndex(drw->dpy, dotfont->xfont, '.');
+        XftGlyphExtents(drw->dpy, dotfont->xfont, &dot, 1, &ext);
+        dotw = ext.xOff;
+        while (n && ew + 3 * dotw > w) ew -= advance[--n];
+        for (i = 0; i < 3 && n < GLYPH_MAX && ew + dotw <= w; i++, n++) {
+            usedfont[n] = dotfont;
+            specs[n].font = dotfont->xfont;
+            specs[n].glyph = dot;
+            advance[n] = dotw;
+            ew += dotw;
         }
+    }
 
-        if (!*text) {
-            break;
-        } else if (nextfont) {
-            charexists = 0;
-            usedfont = nextfont;
-        } else {
-            /* Regardless of whether or not a fallback font is found, the
-             * character must be drawn. */
-            charexists = 1;
-
-            fccharset = FcCharSetCreate();
-            FcCharSetAddChar(fccharset, utf8codepoint);
-
-            if (!drw->fonts->pattern) {
-                /* Refer to the comment in xfont_create for more information. */
-                die("the first font in the cache must be loaded from a font string.");
+    if (render && n) {
+        /* glyphs lost to a reset are uploaded again, those lost once more
+         * are left out rather than drawn from reused space */
+        for (i = 0; i < n; i++)
+            if (!specs[i].font && colorslot[i] >= 0 && colorgen[i] != drw->atlas->generation) {
+                g = atlas_glyph(drw, usedfont[i], specs[i].glyph);
+                colorslot[i] = g ? g - drw->atlas->glyphs : -1;
+                colorgen[i] = drw->atlas->generation;
             }
-
-            fcpattern = FcPatternDuplicate(drw->fonts->pattern);
-            FcPatternAddCharSet(fcpattern, FC_CHARSET, fccharset);
-            FcPatternAddBool(fcpattern, FC_SCALABLE, FcTrue);
-            FcPatternAddBool(fcpattern, FC_COLOR, FcFalse);
-
-            FcConfigSubstitute(NULL, fcpattern, FcMatchPattern);
-            FcDefaultSubstitute(fcpattern);
-            match = XftFontMatch(drw->dpy, drw->screen, fcpattern, &result);
-
-            FcCharSetDestroy(fccharset);
-            FcPatternDestroy(fcpattern);
-
-            if (match) {
-                usedfont = xfont_create(drw, NULL, match);
-                if (usedfont && XftCharExists(drw->dpy, usedfont->xfont, utf8codepoint)) {
-                    for (curfont = drw->fonts; curfont->next; curfont = curfont->next)
-                        ; /* NOP */
-                    curfont->next = usedfont;
-                } else {
-                    xfont_free(usedfont);
-                    usedfont = drw->fonts;
-                }
+        /* color glyphs are composited from the atlas, the rest stay in
+         * specs for the single Xft request */
+        for (i = j = 0, ew = 0; i < n; ew += advance[i++]) {
+            if (!specs[i].font) {
+                if (colorslot[i] < 0 || colorgen[i] != drw->atlas->generation) continue;
+                g = &drw->atlas->glyphs[colorslot[i]];
+                ty = y + (h - drw->fonts->h) / 2 + drw->fonts->xfont->ascent;
+                XRenderComposite(drw->dpy, PictOpOver, drw->atlas->picture, None, drw_renderpicture(drw), g->x, g->y, 0, 0,
+                                 x + ew + g->left, ty - g->top, g->w, g->h);
+                continue;
             }
+            specs[j] = specs[i];
+            specs[j].x = x + ew;
+            specs[j++].y = y + (h - usedfont[i]->h) / 2 + usedfont[i]->xfont->ascent;
         }
+        if (j) XftDrawGlyphFontSpec(drw->xftdraw, &drw->scheme[invert ? ColBg : ColFg], specs, j);
     }
-    if (d) XftDrawDestroy(d);
 
-    return x + (render ? w : 0);
+    return render ? (int)(x + w) : (int)ew;
 }
 
 void drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h) {
+    XRectangle *r;
+    int i, j, x1, y1, x2, y2;
+
     if (!drw) return;
 
-    XCopyArea(drw->dpy, drw->drawable, win, drw->gc, x, y, w, h, x, y);
-    XSync(drw->dpy, False);
+    /* no XSync here, the event loop flushes once per batch */
+    for (i = j = 0; i < drw->ndamage; i++) {
+        r = &drw->damage[i];
+        x1 = MAX(r->x, x);
+        y1 = MAX(r->y, y);
+        x2 = MIN(r->x + r->width, x + (int)w);
+        y2 = MIN(r->y + r->height, y + (int)h);
+        if (x1 < x2 && y1 < y2) XCopyArea(drw->dpy, drw->drawable, win, drw->gc, x1, y1, x2 - x1, y2 - y1, x1, y1);
+        /* keep what lies partly outside the mapped region */
+        if (r->x < x || r->y < y || r->x + r->width > x + (int)w || r->y + r->height > y + (int)h) drw->damage[j++] = *r;
+    }
+    drw->ndamage = j;
 }
 
 unsigned int drw_fontset_getwidth(Drw *drw, const char *text) {
@@ -7,23 +7,35 @@ typedef struct {
 typedef struct Fnt {
     Display *dpy;
     unsigned int h;
-    XftFont *xfont;
+    XftFont *xfont; /* NULL for color fonts */
+    FT_Face face;   /* color fonts, drawn from the glyph atlas */
     FcPattern *pattern;
     struct Fnt *next;
 } Fnt;
 
+typedef struct FontCache FontCache; /* persistent fallback font coverage */
+typedef struct Atlas Atlas;         /* server-side cache of color glyphs */
+
 enum { ColFg, ColBg, ColBorder }; /* Clr scheme index */
 typedef XftColor Clr;
 
+#define DAMAGE_MAX 8 /* dirty rectangles tracked before merging */
+
 typedef struct {
     unsigned int w, h;
     Display *dpy;
     int screen;
     Window root;
     Drawable drawable;
+    XftDraw *xftdraw;
+    Picture picture; /* XRender view of drawable, for color glyphs */
     GC gc;
     Clr *scheme;
     Fnt *fonts;
+    FontCache *fcache;
+    Atlas *atlas;
+    XRectangle damage[DAMAGE_MAX];
+    int ndamage;
 } Drw;
 
 /* Drawable abstraction */
@@ -36,6 +48,8 @@ Fnt *drw_fontset_create(Drw *drw, const char *fonts[], size_t fontcount);
 void drw_fontset_free(Fnt *set);
 unsigned int drw_fontset_getwidth(Drw *drw, const char *text);
 void drw_font_getexts(Fnt *font, const char *text, unsigned int len, unsigned int *w, unsigned int *h);
+void drw_fontcache_load(Drw *drw, const char *path);
+void drw_fontcache_save(Drw *drw);
 
 /* Colorscheme abstraction */
 void drw_clr_create(Drw *drw, Clr *dest, const char *clrname);
@@ -50,8 +64,9 @@ void drw_setfontset(Drw *drw, Fnt *set);
 void drw_setscheme(Drw *drw, Clr *scm);
 
 /* Drawing functions */
+void drw_picture(Drw *drw, Picture src, int x, int y, unsigned int w, unsigned int h);
 void drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int invert);
 int drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lpad, const char *text, int invert);
 
-/* Map functions */
+/* Map functions, only the damaged parts of the region are copied */
 void drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h);
@@ -20,29 +20,61 @@
  *
  * To understand everything else, start reading main().
  */
+#include <X11/XKBlib.h>
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/Xproto.h>
 #include <X11/Xutil.h>
 #include <X11/cursorfont.h>
 #include <X11/keysym.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include <X11/extensions/Xinerama.h>
+#include <X11/extensions/sync.h>
 #include <X11/Xft/Xft.h>
+#include <xcb/xcb.h>
 
+#ifdef COMPOSITOR
+#include "comp.h"
+#endif
+#include "async.h"
 #include "drw.h"
+#include "fetch.h"
+#include "launch.h"
+#ifdef PACING
+#include "pace.h"
+#endif
+#include "pool.h"
+#ifdef XREADER
+#include "reader.h"
+#endif
+#include "status.h"
+#include "trigram.h"
+#ifdef OVERVIEW
+#include "thumb.h"
+#endif
 #include "util.h"
+#ifdef WALLPAPER
+#include "wall.h"
+#endif
 
 /* macros */
 #define BUTTONMASK (ButtonPressMask | ButtonReleaseMask)
@@ -53,27 +85,41 @@
 #define ISVISIBLE(C) ((C->tags & C->mon->tagset[C->mon->seltags]))
 #define LENGTH(X) (sizeof X / sizeof X[0])
 #define MOUSEMASK (BUTTONMASK | PointerMotionMask)
+#define ROOTMASK \
+    (SubstructureRedirectMask | SubstructureNotifyMask | ButtonPressMask | PointerMotionMask | EnterWindowMask | LeaveWindowMask \
+     | StructureNotifyMask | PropertyChangeMask)
 #define WIDTH(X) ((X)->w + 2 * (X)->bw)
 #define HEIGHT(X) ((X)->h + 2 * (X)->bw)
 #define TAGMASK ((1 << LENGTH(tags)) - 1)
 #define TEXTW(X) (drw_fontset_getwidth(drw, (X)) + lrpad)
+#define WHEELSLOTS 64 /* slots of the timer wheel, one tick per second */
 
 /* enums */
 enum { CurNormal, CurResize, CurMove, CurLast }; /* cursor */
+enum { SchemeNorm, SchemeSel };                  /* color schemes */
 enum {
     NetSupported,
     NetWMName,
     NetWMState,
     NetWMCheck,
     NetWMFullscreen,
+    NetWMBypassCompositor,
+    NetWMPid,
     NetActiveWindow,
     NetWMWindowType,
     NetWMWindowTypeDialog,
     NetClientList,
+    NetNumberOfDesktops,
+    NetCurrentDesktop,
+    NetDesktopNames,
+    NetWMDesktop,
     NetLast
 };                                                                                              /* EWMH atoms */
 enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMLast };                                   /* default atoms */
 enum { ClkTagBar, ClkStatusText, ClkWinTitle, ClkClientWin, ClkRootWin, ClkLast }; /* clicks */
+enum { DeferArrange = 1, DeferBars = 2, DeferClientList = 4, DeferTitles = 8, DeferDesktops = 16 }; /* put off in game mode */
+enum { PromptCancel = -1, PromptInput = -2 };                                      /* prompt() results besides items */
+enum { IdleClientList, IdleFontCache, IdleLaunchCounts, IdleLast };                /* work put off until dwm is idle */
 
 typedef union {
     long i;
@@ -94,6 +140,7 @@ typedef struct Monitor Monitor;
 typedef struct Client Client;
 struct Client {
     char name[256];
+    char class[64];
     float mina, maxa;
     int x, y, w, h;
     int oldx, oldy, oldw, oldh;
@@ -101,6 +148,12 @@ struct Client {
     int bw, oldbw;
     unsigned int tags;
     int isfixed, isfloating, isurgent, neverfocus, oldstate, isfullscreen;
+    int bypass, ownbypass; /* may bypass the compositor, we set the hint */
+    long long fstime;      /* when it went fullscreen, in ms */
+    int dirtytitle;        /* title changed in game mode */
+    unsigned int slot;     /* id in the title index */
+    unsigned long lastfocus;
+    long desktop;          /* published _NET_WM_DESKTOP, -2 before */
     Client *next;
     Client *snext;
     Monitor *mon;
@@ -114,6 +167,24 @@ typedef struct {
     const Arg arg;
 } Key;
 
+typedef struct {
+    void (*func)(const Arg *);
+    int isfloat; /* sums arg.f, else arg.i */
+} Repeatable;
+
+typedef struct {
+    Client *c;
+    int x, y, w, h;
+} Placement; /* geometry a layout computed, applied by applylayout() */
+
+typedef struct {
+    unsigned int tags, occ, urg, sel; /* tag indicator bits */
+    int statusw;
+    int titlesel, titlefloating, titlefixed, hastitle;
+    char title[256];
+    char status[256];
+} BarState; /* what is currently painted on a built-in bar */
+
 struct Monitor {
     float mfact;
     int nmaster;
@@ -130,8 +201,42 @@ struct Monitor {
     Monitor *next;
     Window barwin;
     Window traywin;
+    int isaltbar;   /* barwin is the external altbarclass bar */
+    int barinvalid; /* repaint every segment of the built-in bar */
+    BarState bar;
+    Placement *placed; /* by the last tile(), only changed clients */
+    unsigned int nplaced, placedsize;
 };
 
+typedef struct {
+    char id[16];
+    char text[64];
+} StatusSeg; /* named part of the status text, see readstatus() */
+
+typedef struct Timer Timer;
+struct Timer {
+    unsigned int interval; /* ticks */
+    unsigned int rounds;   /* wheel turns left before it fires */
+    void (*func)(Timer *t);
+    Timer *next;
+}; /* entry of the timer wheel driven by run() */
+
+typedef struct {
+    int fd;
+    void (*func)(int fd);
+} Watch; /* file descriptor polled by run() next to the X connection */
+
+typedef struct {
+    void (*func)();
+    int heavy; /* waits for the user to be idle as well */
+} IdleTask; /* see runidle() */
+
+typedef struct {
+    const char *label;
+    size_t (*filter)(const char *input, unsigned int *items, size_t max); /* best first */
+    const char *(*text)(unsigned int item);
+} Prompt; /* source of the items prompt() lists */
+
 typedef struct {
     const char *class;
     const char *instance;
@@ -139,19 +244,27 @@ typedef struct {
     unsigned int tags;
     int isfloating;
     int monitor;
+    int bypass; /* unredirect it while fullscreen */
 } Rule;
 
 /* function declarations */
+static void addtimer(Timer *t);
+static void applylayout(Monitor *m);
 static void applyrules(Client *c);
 static int applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact);
 static void arrange(Monitor *m);
 static void attach(Client *c);
 static void attachstack(Client *c);
 static void buttonpress(XEvent *e);
+static char *cachepath(const char *name);
 static void checkotherwm();
+static xcb_get_property_reply_t *checkprop(void *reply);
 static void cleanup();
 static void cleanupmon(Monitor *mon);
 static void clientmessage(XEvent *e);
+#ifdef PACING
+static void commitlayouts();
+#endif
 static void configure(Client *c);
 static void configurenotify(XEvent *e);
 static void configurerequest(XEvent *e);
@@ -160,51 +273,113 @@ static void destroynotify(XEvent *e);
 static void detach(Client *c);
 static void detachstack(Client *c);
 static Monitor *dirtomon(int dir);
+static void drawbar(Monitor *m);
+static void drawbars();
 static void enternotify(XEvent *e);
+static int eventspending();
+static void expose(XEvent *e);
+static void fetchdone(int fd);
+static int fillbatch();
+static void flushrepeat();
 static void focus(Client *c);
 static void focusin(XEvent *e);
 static void focusmon(const Arg *arg);
 static void focusstack(const Arg *arg);
-static Atom getatomprop(Client *c, Atom prop);
+static Atom getatomreply(xcb_get_property_cookie_t ck);
+static long long getms();
+static xcb_get_property_cookie_t getprop(Window w, Atom prop, Atom type, uint32_t words);
+static xcb_get_property_reply_t *getpropreply(xcb_get_property_cookie_t ck);
 static int getrootptr(int *x, int *y);
-static long getstate(Window w);
+static long getstatereply(xcb_get_property_cookie_t ck);
 static int gettextprop(Window w, Atom atom, char *text, unsigned int size);
 static void grabbuttons(Client *c, int focused);
 static void grabkeys();
+static void handlebatch();
+static void handleevent(XEvent *ev);
+static void idlealarm(XSyncAlarmNotifyEvent *ev);
 static void incnmaster(const Arg *arg);
+static void indexclient(Client *c);
 static void keypress(XEvent *e);
 static void killclient(const Arg *arg);
+static void launcher(const Arg *arg);
 static void manage(Window w, XWindowAttributes *wa);
 static void managealtbar(Window win, XWindowAttributes *wa);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
+static void mergebatch();
+static int modalevent(XEvent *ev, Window win);
+static Bool modalpredicate(Display *dpy, XEvent *ev, XPointer arg);
 static void motionnotify(XEvent *e);
 static void movemouse(const Arg *arg);
+static void moveresizeclient(Client *c, int x, int y, int w, int h);
+static int mrucmp(const void *a, const void *b);
+static void nettitlereply(void *reply, void *arg);
 static Client *nexttiled(Client *c);
+#ifdef OVERVIEW
+static void overview(const Arg *arg);
+static void overviewdraw(Window win, Monitor *m, Client **cs, int n, int sel, int cols);
+#endif
+static void pauseevents();
+static int place(Monitor *m, Client *c, int x, int y, int w, int h);
 static void pop(Client *);
+static void postidle(int task);
+static int prompt(const Prompt *p, char *input, size_t size);
+static void promptdraw(const Prompt *p, const char *input, unsigned int *items, size_t n, size_t lines, int sel);
 static void propertynotify(XEvent *e);
 static void quit(const Arg *arg);
+static void readstatus(int fd);
 static Monitor *recttomon(int x, int y, int w, int h);
+static int replytext(xcb_get_property_reply_t *r, char *text, unsigned int size);
 static void resize(Client *c, int x, int y, int w, int h, int interact);
 static void resizeclient(Client *c, int x, int y, int w, int h);
 static void resizemouse(const Arg *arg);
 static void restack(Monitor *m);
+static void resumeevents();
 static void run();
 static void runautostart();
+static void runidle();
+static void runmodule(Timer *t);
+static void runtimers(int fd);
+static void savefontcache();
 static void scan();
 static int sendevent(Client *c, Atom proto);
 static void sendmon(Client *c, Monitor *m);
+static void setbypass(Client *c, int bypass);
 static void setclientstate(Client *c, long state);
 static void setfocus(Client *c);
 static void setfullscreen(Client *c, int fullscreen);
+static void setgamemode(Client *c);
 static void setmfact(const Arg *arg);
+static void setsegment(const char *id, const char *text);
+static void setsizehints(Client *c, xcb_get_property_reply_t *r);
 static void setup();
+static void setupfontcache();
+static void setupidle();
+static void setuplauncher();
+#ifdef PACING
+static void setuppacing();
+#endif
+static void setupstatusfifo();
+static void setuptimers();
+#ifdef WALLPAPER
+static void setupwallpaper();
+#endif
 static void seturgent(Client *c, int urg);
 static void showhide(Client *c);
 static void sigchld(int unused);
+static void sizedrw(unsigned int h);
+static void sizehintsreply(void *reply, void *arg);
 static void spawn(const Arg *arg);
+static int sumrepeat(const Key *k);
+static void switcher(const Arg *arg);
+static size_t switchfilter(const char *input, unsigned int *items, size_t max);
+static const char *switchtext(unsigned int item);
+static void tag(const Arg *arg);
+static long tagdesktop(unsigned int tagset);
 static void tagmon(const Arg *arg);
 static void tile(Monitor *);
+static void tilemon(size_t i, void *mons);
+static void titlereply(void *reply, void *arg);
 static void togglefloating(const Arg *arg);
 static void togglefullscr(const Arg *arg);
 static void toggletag(const Arg *arg);
@@ -215,14 +390,22 @@ static void unmanagealtbar(Window w);
 static void unmanagetray(Window w);
 static void unmapnotify(XEvent *e);
 static void updatebarpos(Monitor *m);
+static void updatebars();
 static void updateclientlist();
+static void updatecurrentdesktop();
+static void updatedesktop(Client *c);
 static int updategeom();
 static void updatenumlockmask();
 static void updatesizehints(Client *c);
+static void updatestatus();
 static void updatetitle(Client *c);
+#ifdef WALLPAPER
+static void updatewallpaper();
+#endif
 static void updatewindowtype(Client *c);
 static void updatewmhints(Client *c);
 static void view(const Arg *arg);
+static void watchfd(int fd, void (*func)(int fd));
 static Client *wintoclient(Window w);
 static Monitor *wintomon(Window w);
 static int wmclasscontains(Window win, const char *class, const char *name);
@@ -238,12 +421,31 @@ static void comboview(const Arg *arg);
 /* variables */
 static const char broken[] = "broken";
 static char stext[256];
+static StatusSeg segments[16];
+static int nsegments;
+static int rawstatus; /* stext came whole from the root name or the FIFO */
+static char *statuspath;
+static int statusfd = -1;
+static Watch watches[8];
+static int nwatches;
+static Timer *wheel[WHEELSLOTS];
+static unsigned int wheelpos;
+static int timerfd = -1;
 static int screen;
 static int sw, sh;      /* X display screen geometry width, height */
 static int bh; /* bar geometry */
 static int lrpad;       /* sum of left and right padding for text */
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int numlockmask = 0;
+static const IdleTask idletasks[IdleLast] = {
+    [IdleClientList] = {updateclientlist, 0},
+    [IdleFontCache] = {savefontcache, 1},
+    [IdleLaunchCounts] = {launch_save, 1},
+};
+static unsigned int idlepending; /* bits of idletasks */
+static int useridle;             /* no input for idletimeout */
+static int syncevbase = -1;
+static XSyncAlarm idlealarms[2]; /* the user turns idle, the user is back */
 static void (*handler[LASTEvent])(XEvent *) = {[ButtonPress] = buttonpress,
                                                [ButtonRelease] = keyrelease,
                                                [ClientMessage] = clientmessage,
@@ -251,6 +453,7 @@ static void (*handler[LASTEvent])(XEvent *) = {[ButtonPress] = buttonpress,
                                                [ConfigureNotify] = configurenotify,
                                                [DestroyNotify] = destroynotify,
                                                [EnterNotify] = enternotify,
+                                               [Expose] = expose,
                                                [FocusIn] = focusin,
                                                [KeyRelease] = keyrelease,
                                                [KeyPress] = keypress,
@@ -262,10 +465,44 @@ static void (*handler[LASTEvent])(XEvent *) = {[ButtonPress] = buttonpress,
 static Atom wmatom[WMLast], netatom[NetLast];
 static int running = 1;
 static Cur *cursor[CurLast];
+static Clr **scheme;
 static Display *dpy;
+static xcb_connection_t *xc; /* dpy's connection, for requests whose replies are collected later */
 static Drw *drw;
 static Monitor *mons, *selmon;
 static Window root, wmcheckwin;
+static Client *gameclient; /* focused fullscreen client, see setgamemode() */
+static TriIndex *titleindex; /* titles and classes of all clients */
+static Client **slots;       /* clients by their index slot */
+static unsigned int nslots;
+static unsigned long focusclock;
+static Window promptwin;
+static const Prompt switchprompt = {"window", switchfilter, switchtext};
+static const Prompt launchprompt = {"run", launch_query, launch_name};
+static unsigned int deferred;
+static XEvent batch[128]; /* events read but not handled yet, see handlebatch() */
+static unsigned char batchdone[LENGTH(batch)];
+static int nbatch;
+static int eventspaused; /* see pauseevents() */
+static unsigned long merged; /* events mergebatch() saved */
+static pid_t gamepid;
+static int gameprio;
+static Pool *layoutpool;
+static int fetchfd = -1; /* readable with results of the fetch worker */
+#ifdef COMPOSITOR
+static int compositing;
+#endif
+#ifdef OVERVIEW
+static int thumbs; /* the thumbnail cache is up */
+#endif
+#ifdef PACING
+static int pacing;     /* layouts wait for vblank */
+static int committing; /* commitlayouts() arranges */
+#endif
+#ifdef XREADER
+static int readerfd = -1; /* readable with events the reader took */
+static long long batchwhen[LENGTH(batch)];
+#endif
 
 // --------------------------------- CONFIG START ------------------------
 
@@ -273,7 +510,40 @@ static Window root, wmcheckwin;
 static const unsigned int borderpx = 0; /* border pixel of windows */
 static const unsigned int gappx = 10;
 static const unsigned int snap = 32;        /* snap pixel */
+static const int gamenice = 0;              /* nice value of a focused fullscreen client, 0 leaves it alone */
 static const char *altbarclass = "Polybar"; /* Alternate bar class name */
+static const int showbar = 1;               /* 0 means only use the altbarclass bar */
+static const unsigned int promptlines = 10; /* items listed below prompts */
+#ifdef COMPOSITOR
+static const int compositor = 1; /* composite in dwm instead of running picom */
+#endif
+#ifdef OVERVIEW
+static const size_t thumbbudget = 32 << 20; /* bytes of overview thumbnails kept */
+#endif
+#ifdef WALLPAPER
+static const char *wallpaper = "~/desktop.*"; /* glob(7), the first match is scaled onto every monitor */
+#endif
+static const char *statusfifo = "dwm/status"; /* relative to $XDG_RUNTIME_DIR, NULL to disable */
+static const char *statussep = " | ";         /* joins status segments */
+static const StatusModule statusmodules[] = {
+        /* segment   function        argument           interval (s) */
+        /* {"cpu", status_cpu, NULL, 2}, */
+        /* {"mem", status_mem, NULL, 5}, */
+        /* {"bat", status_battery, "BAT0", 30}, */
+        /* {"net", status_net, "eth0", 2}, */
+        /* {"clock", status_clock, "%a %d %b %H:%M", 1}, */
+};
+static const char *fonts[] = {"monospace:size=10"};
+static const char col_gray1[] = "#222222";
+static const char col_gray2[] = "#444444";
+static const char col_gray3[] = "#bbbbbb";
+static const char col_gray4[] = "#eeeeee";
+static const char col_cyan[] = "#005577";
+static const char *colors[][3] = {
+        /*               fg         bg         border   */
+        [SchemeNorm] = {col_gray3, col_gray1, col_gray2},
+        [SchemeSel] = {col_gray4, col_cyan, col_cyan},
+};
 /* tagging */
 static const char *tags[] = {"1", "2", "3", "4", "5", "6", "7", "8", "9"};
 
@@ -281,14 +551,16 @@ static const Rule rules[] = {
         /* xprop(1): */
         /* 	WM_CLASS(STRING) = instance, class */
         /* 	WM_NAME(STRING) = title */
-        /* class      instance    title       tags mask     isfloating   monitor */
-        {"Gimp", NULL, NULL, 0, 1, -1},
-        {"Firefox", NULL, NULL, 1 << 8, 0, -1},
+        /* class      instance    title       tags mask     isfloating   monitor   bypass */
+        {"Gimp", NULL, NULL, 0, 1, -1, 1},
+        {"Firefox", NULL, NULL, 1 << 8, 0, -1, 1},
 };
 
 static const float mfact = 0.55;  /* factor of master area size [0.05..0.95] */
 static const int nmaster = 1;     /* number of clients in master area */
 static const int resizehints = 1; /* 1 means respect size hints in tiled resizals */
+static const int layoutthreads = 3; /* threads tiling monitors besides the main one, 0 tiles them in turn */
+static const int idletimeout = 10000; /* ms without input before heavy idle tasks run, see runidle() */
 
 /* key definitions */
 #define MODKEY Mod4Mask
@@ -305,11 +577,16 @@ static const char *zealcmd[] = {"zeal", NULL};
 
 static Key keys[] = {
         /* modifier                     key        function        argument */
-        {MODKEY, XK_d, spawn, {.v = runnercmd}},
+        {MODKEY, XK_d, launcher, {0}},
+        {MODKEY | ShiftMask, XK_d, spawn, {.v = runnercmd}},
+        {MODKEY, XK_w, switcher, {0}},
         {MODKEY, XK_Return, spawn, {.v = termcmd}},
         {MODKEY, XK_b, spawn, {.v = browsercmd}},
         {MODKEY | ShiftMask, XK_p, spawn, {.v = lockcmd}},
         {MODKEY, XK_z, spawn, {.v = zealcmd}},
+#ifdef OVERVIEW
+        {MODKEY, XK_Tab, overview, {0}},
+#endif
         {MODKEY, XK_j, focusstack, {.i = +1}},
         {MODKEY, XK_k, focusstack, {.i = -1}},
         {MODKEY, XK_u, incnmaster, {.i = +1}},
@@ -330,10 +607,23 @@ static Key keys[] = {
                 TAGKEYS(XK_8, 7) TAGKEYS(XK_9, 8){MODKEY | ShiftMask, XK_e, quit, {0}},
 };
 
+/* bindings whose autorepeats are summed and applied once per batch */
+static const Repeatable repeatables[] = {
+        /* function     isfloat */
+        {focusstack, 0},
+        {incnmaster, 0},
+        {setmfact, 1},
+};
+
 /* button definitions */
 /* click can be ClkTagBar, ClkStatusText, ClkWinTitle,
  * ClkClientWin, or ClkRootWin */
 static Button buttons[] = {
+        {ClkTagBar, 0, Button1, view, {0}},
+        {ClkTagBar, 0, Button3, toggleview, {0}},
+        {ClkTagBar, MODKEY, Button1, tag, {0}},
+        {ClkTagBar, MODKEY, Button3, toggletag, {0}},
+        {ClkWinTitle, 0, Button2, zoom, {0}},
         {ClkClientWin, MODKEY, Button1, movemouse, {0}},
         {ClkClientWin, MODKEY, Button2, togglefloating, {0}},
         {ClkClientWin, MODKEY, Button3, resizemouse, {0}},
@@ -345,10 +635,20 @@ struct NumTags {
     char limitexceeded[LENGTH(tags) > 31 ? -1 : 1];
 };
 
+static ModState modstate[LENGTH(statusmodules)];
+static Timer modtimer[LENGTH(statusmodules)];
+
 /* function implementations */
 static int combo = 0;
+static KeyCode heldkey;      /* pressed and not released yet */
+static const Key *repeatkey; /* binding whose repeats sumrepeat() holds */
+static Arg repeatarg;
 
-void keyrelease(XEvent *e) { combo = 0; }
+void keyrelease(XEvent *e) {
+    /* ButtonRelease shares it, its button isn't a keycode */
+    if (e->type == KeyRelease && e->xkey.keycode == heldkey) heldkey = 0;
+    combo = 0;
+}
 
 void combotag(const Arg *arg) {
     if (selmon->sel && arg->ui & TAGMASK) {
@@ -358,6 +658,7 @@ void combotag(const Arg *arg) {
             combo = 1;
             selmon->sel->tags = arg->ui & TAGMASK;
         }
+        updatedesktop(selmon->sel);
         focus(NULL);
         arrange(selmon);
     }
@@ -376,6 +677,24 @@ void comboview(const Arg *arg) {
     arrange(selmon);
 }
 
+/* Timers expire (interval - 1) % WHEELSLOTS + 1 ticks from now, after
+ * going round the wheel rounds more times. */
+void addtimer(Timer *t) {
+    t->rounds = (t->interval - 1) / WHEELSLOTS;
+    t->next = wheel[(wheelpos + t->interval) % WHEELSLOTS];
+    wheel[(wheelpos + t->interval) % WHEELSLOTS] = t;
+}
+
+/* Configures the clients the last tile() of m moved without waiting for
+ * the server, callers sync once for all monitors. */
+void applylayout(Monitor *m) {
+    unsigned int i;
+    Placement *p;
+
+    for (i = 0, p = m->placed; i < m->nplaced; i++, p++) moveresizeclient(p->c, p->x, p->y, p->w, p->h);
+    m->nplaced = 0;
+}
+
 void applyrules(Client *c) {
     const char *class, *instance;
     unsigned int i;
@@ -386,15 +705,18 @@ void applyrules(Client *c) {
     /* rule matching */
     c->isfloating = 0;
     c->tags = 0;
+    c->bypass = 1;
     XGetClassHint(dpy, c->win, &ch);
     class = ch.res_class ? ch.res_class : broken;
     instance = ch.res_name ? ch.res_name : broken;
+    strncpy(c->class, class, sizeof c->class - 1);
 
     for (i = 0; i < LENGTH(rules); i++) {
         r = &rules[i];
         if ((!r->title || strstr(c->name, r->title)) && (!r->class || strstr(class, r->class))
             && (!r->instance || strstr(instance, r->instance))) {
             c->isfloating = r->isfloating;
+            c->bypass = r->bypass;
             c->tags |= r->tags;
             for (m = mons; m && m->num != r->monitor; m = m->next)
                 ;
@@ -457,15 +779,48 @@ int applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact) {
 }
 
 void arrange(Monitor *m) {
+    Monitor **ms;
+    size_t i, n;
+
+    if (gameclient && m != gameclient->mon) {
+        /* the other monitors catch up when game mode ends, leaving the
+         * game's monitor alone unless everything was asked for */
+        deferred |= DeferArrange;
+        if (m) return;
+        m = gameclient->mon;
+    }
+#ifdef PACING
+    /* committed at the next vblank of the monitor, several arranges within
+     * a frame cost one. Game mode and loops reading events themselves see
+     * them right away. */
+    if (pacing && !committing && !gameclient && !eventspaused) {
+        Monitor *mon;
+
+        for (mon = m ? m : mons; mon && pace_request(mon->num, mon->mx, mon->my) == 0; mon = m ? NULL : mon->next)
+            ;
+        if (!mon) return;
+    }
+#endif
     if (m)
         showhide(m->stack);
     else
         for (m = mons; m; m = m->next) showhide(m->stack);
     if (m) {
         tile(m);
+        applylayout(m);
         restack(m);
-    } else
-        for (m = mons; m; m = m->next) tile(m);
+        return;
+    }
+    /* monitors don't share clients, so they tile in parallel and only the
+     * main thread talks to the server */
+    for (n = 0, m = mons; m; m = m->next, n++)
+        ;
+    ms = ecalloc(n, sizeof(Monitor *));
+    for (i = 0, m = mons; m; m = m->next) ms[i++] = m;
+    pool_for(layoutpool, n, tilemon, ms);
+    for (i = 0; i < n; i++) applylayout(ms[i]);
+    free(ms);
+    XSync(dpy, False);
 }
 
 void attach(Client *c) {
@@ -485,6 +840,7 @@ void buttonpress(XEvent *e) {
     Monitor *m;
     XButtonPressedEvent *ev = &e->xbutton;
 
+    flushrepeat(); /* what the keys did comes first */
     click = ClkRootWin;
     /* focus monitor if necessary */
     if ((m = wintomon(ev->window)) && m != selmon) {
@@ -517,6 +873,22 @@ void buttonpress(XEvent *e) {
             buttons[i].func(click == ClkTagBar && buttons[i].arg.i == 0 ? &arg : &buttons[i].arg);
 }
 
+/* Returns the path of name in dwm's cache directory, which is created, or
+ * NULL without $XDG_CACHE_HOME and $HOME. */
+char *cachepath(const char *name) {
+    const char *dir = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    char *path, *parent;
+
+    if (!dir && !home) return NULL;
+    path = ecalloc((dir ? strlen(dir) : strlen(home) + strlen("/.cache")) + strlen("/dwm/") + strlen(name) + 1, 1);
+    sprintf(path, "%s%s/dwm/%s", dir ? dir : home, dir ? "" : "/.cache", name);
+    if (parentdir(path, &parent) == 0) {
+        mkdirp(parent);
+        free(parent);
+    }
+    return path;
+}
+
 void checkotherwm() {
     xerrorxlib = XSetErrorHandler(xerrorstart);
     /* this causes an error if some other window manager is running */
@@ -526,18 +898,70 @@ void checkotherwm() {
     XSync(dpy, False);
 }
 
+/* Returns reply, or NULL if the property is unset and then frees it. */
+xcb_get_property_reply_t *checkprop(void *reply) {
+    xcb_get_property_reply_t *r = reply;
+
+    if (r && (r->type == XCB_NONE || !xcb_get_property_value_length(r))) {
+        free(r);
+        r = NULL;
+    }
+    return r;
+}
+
 void cleanup() {
     Arg a = {.ui = ~0};
     Monitor *m;
+    ModState *ms;
     size_t i;
 
+#ifdef XREADER
+    reader_stop();
+    readerfd = -1;
+#endif
+#ifdef PACING
+    if (pacing) pace_cleanup();
+    pacing = 0;
+#endif
     view(&a);
     for (m = mons; m; m = m->next)
         while (m->stack) unmanage(m->stack, 0);
     XUngrabKey(dpy, AnyKey, AnyModifier, root);
     while (mons) cleanupmon(mons);
     for (i = 0; i < CurLast; i++) drw_cur_free(drw, cursor[i]);
+    for (i = 0; i < LENGTH(colors); i++) free(scheme[i]);
+    free(scheme);
     XDestroyWindow(dpy, wmcheckwin);
+    if (statusfd >= 0) close(statusfd);
+    if (timerfd >= 0) close(timerfd);
+    for (i = 0; i < LENGTH(idlealarms); i++)
+        if (idlealarms[i]) XSyncDestroyAlarm(dpy, idlealarms[i]);
+    /* by pointer, there may be no modules at all */
+    for (ms = modstate; ms < modstate + LENGTH(modstate); ms++) {
+        if (ms->fd[0] > 0) close(ms->fd[0]);
+        if (ms->fd[1] > 0) close(ms->fd[1]);
+    }
+    if (statuspath) {
+        unlink(statuspath);
+        free(statuspath);
+    }
+#ifdef COMPOSITOR
+    if (compositing) comp_cleanup();
+#endif
+#ifdef OVERVIEW
+    if (thumbs) thumb_cleanup();
+#endif
+    tri_free(titleindex);
+    launch_cleanup();
+    pool_free(layoutpool);
+    async_cleanup();
+    fetch_cleanup();
+    fetchfd = -1;
+#ifdef WALLPAPER
+    wall_cleanup();
+#endif
+    free(slots);
+    drw_fontcache_save(drw);
     drw_free(drw);
     XSync(dpy, False);
     XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
@@ -554,13 +978,26 @@ void cleanupmon(Monitor *mon) {
             ;
         m->next = mon->next;
     }
+    if (mon->barwin && !mon->isaltbar) {
+        XUnmapWindow(dpy, mon->barwin);
+        XDestroyWindow(dpy, mon->barwin);
+    }
+    free(mon->placed);
     free(mon);
 }
 
 void clientmessage(XEvent *e) {
     XClientMessageEvent *cme = &e->xclient;
     Client *c = wintoclient(cme->window);
+    Arg a;
 
+    if (cme->window == root && cme->message_type == netatom[NetCurrentDesktop]) {
+        if (cme->data.l[0] >= 0 && cme->data.l[0] < (long)LENGTH(tags)) {
+            a.ui = 1 << cme->data.l[0];
+            view(&a);
+        }
+        return;
+    }
     if (!c) return;
     if (cme->message_type == netatom[NetWMState]) {
         if (cme->data.l[1] == netatom[NetWMFullscreen] || cme->data.l[2] == netatom[NetWMFullscreen])
@@ -568,10 +1005,29 @@ void clientmessage(XEvent *e) {
                           (cme->data.l[0] == 1 /* _NET_WM_STATE_ADD    */
                            || (cme->data.l[0] == 2 /* _NET_WM_STATE_TOGGLE */ && !c->isfullscreen)));
     } else if (cme->message_type == netatom[NetActiveWindow]) {
-        if (c != selmon->sel && !c->isurgent) seturgent(c, 1);
+        if (c != selmon->sel && !c->isurgent) {
+            seturgent(c, 1);
+            drawbar(c->mon);
+        }
     }
 }
 
+#ifdef PACING
+/* Arranges the monitors whose vblank came. */
+void commitlayouts() {
+    Monitor *m;
+    int id;
+
+    while ((id = pace_next()) >= 0)
+        for (m = mons; m; m = m->next)
+            if (m->num == id) {
+                committing = 1;
+                arrange(m);
+                committing = 0;
+            }
+}
+#endif
+
 void configure(Client *c) {
     XConfigureEvent ce;
 
@@ -602,11 +1058,16 @@ void configurenotify(XEvent *e) {
         sh = ev->height;
         if (updategeom() || dirty) {
             drw_resize(drw, sw, bh);
+            updatebars();
             for (m = mons; m; m = m->next) {
                 for (c = m->clients; c; c = c->next)
                     if (c->isfullscreen) resizeclient(c, m->mx, m->my, m->mw, m->mh);
                 XMoveResizeWindow(dpy, m->barwin, m->wx, m->by, m->ww, m->bh);
+                m->barinvalid = 1;
             }
+#ifdef WALLPAPER
+            updatewallpaper();
+#endif
             focus(NULL);
             arrange(NULL);
         }
@@ -720,12 +1181,109 @@ Monitor *dirtomon(int dir) {
     return m;
 }
 
+/* Only the segments whose content changed since the last call are painted
+ * and copied to the bar window. */
+void drawbar(Monitor *m) {
+    int x, w, tw = 0;
+    size_t p, q, len, olen;
+    char buf[sizeof stext];
+    int boxs = drw->fonts->h / 9;
+    int boxw = drw->fonts->h / 6 + 2;
+    unsigned int i, occ = 0, urg = 0, sel, changed;
+    const char *status = m == selmon ? stext : "";
+    BarState *b = &m->bar;
+    Client *c;
+
+    if (!m->barwin || m->isaltbar) return;
+    if (gameclient) {
+        deferred |= DeferBars;
+        return;
+    }
+
+    /* draw status first so it can be overdrawn by tags later */
+    if (m == selmon) tw = TEXTW(stext) - lrpad + 2; /* 2px right padding */
+    if (m->barinvalid || tw != b->statusw) {
+        drw_setscheme(drw, scheme[SchemeNorm]);
+        if (tw) drw_text(drw, m->ww - tw, 0, tw, m->bh, 0, stext, 0);
+        strcpy(b->status, status);
+    } else if (strcmp(status, b->status)) {
+        /* same width, so only the text between the common prefix and
+         * suffix moved; a changed clock does not repaint other segments */
+        len = strlen(status);
+        olen = strlen(b->status);
+        for (p = 0; status[p] == b->status[p]; p++)
+            ;
+        while (p && (status[p] & 0xC0) == 0x80) p--;
+        for (q = 0; q < len - p && q < olen - p && status[len - 1 - q] == b->status[olen - 1 - q]; q++)
+            ;
+        while (q && (status[len - q] & 0xC0) == 0x80) q--;
+        memcpy(buf, status, p);
+        buf[p] = '\0';
+        x = m->ww - tw + drw_fontset_getwidth(drw, buf);
+        memcpy(buf, status + p, len - p - q);
+        buf[len - p - q] = '\0';
+        if ((w = drw_fontset_getwidth(drw, buf))) {
+            drw_setscheme(drw, scheme[SchemeNorm]);
+            drw_text(drw, x, 0, w, m->bh, 0, buf, 0);
+        }
+        strcpy(b->status, status);
+    }
+
+    for (c = m->clients; c; c = c->next) {
+        occ |= c->tags;
+        if (c->isurgent) urg |= c->tags;
+    }
+    sel = m == selmon && selmon->sel ? selmon->sel->tags : 0;
+    changed = (b->tags ^ m->tagset[m->seltags]) | (b->occ ^ occ) | (b->urg ^ urg) | (b->sel ^ sel);
+    if (m->barinvalid) changed = ~0;
+    for (i = x = 0; i < LENGTH(tags); i++, x += w) {
+        w = TEXTW(tags[i]);
+        if (!(changed & 1 << i)) continue;
+        drw_setscheme(drw, scheme[m->tagset[m->seltags] & 1 << i ? SchemeSel : SchemeNorm]);
+        drw_text(drw, x, 0, w, m->bh, lrpad / 2, tags[i], urg & 1 << i);
+        if (occ & 1 << i) drw_rect(drw, x + boxs, boxs, boxw, boxw, sel & 1 << i, urg & 1 << i);
+    }
+    b->tags = m->tagset[m->seltags];
+    b->occ = occ;
+    b->urg = urg;
+    b->sel = sel;
+
+    if ((w = m->ww - tw - x) > m->bh) {
+        c = m->sel;
+        if (m->barinvalid || tw != b->statusw || !c != !b->hastitle || (m == selmon) != b->titlesel
+            || (c && (c->isfloating != b->titlefloating || c->isfixed != b->titlefixed || strcmp(c->name, b->title)))) {
+            if (c) {
+                drw_setscheme(drw, scheme[m == selmon ? SchemeSel : SchemeNorm]);
+                drw_text(drw, x, 0, w, m->bh, lrpad / 2, c->name, 0);
+                if (c->isfloating) drw_rect(drw, x + boxs, boxs, boxw, boxw, c->isfixed, 0);
+                strcpy(b->title, c->name);
+                b->titlefloating = c->isfloating;
+                b->titlefixed = c->isfixed;
+            } else {
+                drw_setscheme(drw, scheme[SchemeNorm]);
+                drw_rect(drw, x, 0, w, m->bh, 1, 1);
+            }
+            b->hastitle = c != NULL;
+            b->titlesel = m == selmon;
+        }
+    }
+    b->statusw = tw;
+    m->barinvalid = 0;
+    drw_map(drw, m->barwin, 0, 0, m->ww, m->bh);
+}
+
+void drawbars() {
+    Monitor *m;
+
+    for (m = mons; m; m = m->next) drawbar(m);
+}
+
 void enternotify(XEvent *e) {
     Client *c;
     Monitor *m;
     XCrossingEvent *ev = &e->xcrossing;
 
-    if ((ev->mode != NotifyNormal || ev->detail == NotifyInferior) && ev->window != root) return;
+    if (gameclient || ((ev->mode != NotifyNormal || ev->detail == NotifyInferior) && ev->window != root)) return;
     c = wintoclient(ev->window);
     m = c ? c->mon : wintomon(ev->window);
     if (m != selmon) {
@@ -736,6 +1294,60 @@ void enternotify(XEvent *e) {
     focus(c);
 }
 
+/* Returns whether events wait to be handled. It reads what the server
+ * sent, poll() doesn't notice events Xlib or XCB read during a round trip. */
+int eventspending() {
+#ifdef XREADER
+    if (readerfd >= 0 && reader_pending()) return 1;
+#endif
+    return XEventsQueued(dpy, QueuedAfterReading);
+}
+
+void expose(XEvent *e) {
+    Monitor *m;
+    XExposeEvent *ev = &e->xexpose;
+
+    if (ev->count == 0 && (m = wintomon(ev->window)) && m->barwin == ev->window) {
+        m->barinvalid = 1;
+        drawbar(m);
+    }
+}
+
+/* Applies what the fetch worker read to clients that are still around. */
+void fetchdone(int fd) {
+    FetchResult r;
+    Client *c;
+
+    while (fetch_take(&r)) {
+        if (!(c = wintoclient(r.win))) continue;
+        if (r.what & FetchTitle) strcpy(c->name, r.name[0] ? r.name : broken);
+        if (r.what & FetchClass) strcpy(c->class, r.class[0] ? r.class : broken);
+        indexclient(c);
+        if (c == c->mon->sel) drawbar(c->mon);
+    }
+}
+
+/* Reads what's there into the batch. Returns how many events it read. */
+int fillbatch() {
+#ifdef XREADER
+    if (readerfd >= 0)
+        nbatch = reader_take(batch, batchwhen, LENGTH(batch));
+    else
+#endif
+        for (nbatch = 0; nbatch < (int)LENGTH(batch) && XEventsQueued(dpy, QueuedAfterReading); nbatch++) XNextEvent(dpy, &batch[nbatch]);
+    memset(batchdone, 0, nbatch);
+    return nbatch;
+}
+
+/* Applies the repeats sumrepeat() held. */
+void flushrepeat() {
+    const Key *k = repeatkey;
+
+    if (!k) return;
+    repeatkey = NULL;
+    k->func(&repeatarg);
+}
+
 void focus(Client *c) {
     if (!c || !ISVISIBLE(c))
         for (c = selmon->stack; c && !ISVISIBLE(c); c = c->snext)
@@ -744,6 +1356,7 @@ void focus(Client *c) {
     if (c) {
         if (c->mon != selmon) selmon = c->mon;
         if (c->isurgent) seturgent(c, 0);
+        c->lastfocus = ++focusclock;
         detachstack(c);
         attachstack(c);
         grabbuttons(c, 1);
@@ -753,6 +1366,9 @@ void focus(Client *c) {
         XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
     }
     selmon->sel = c;
+    setgamemode(c && c->isfullscreen ? c : NULL);
+    updatecurrentdesktop();
+    drawbars();
 }
 
 /* there are some broken focus acquiring clients needing extra handling */
@@ -772,22 +1388,28 @@ void focusmon(const Arg *arg) {
     focus(NULL);
 }
 
+/* Moves the focus abs(arg->i) visible clients on, summed repeats take
+ * several steps at once. */
 void focusstack(const Arg *arg) {
-    Client *c = NULL, *i;
+    Client *c, *i, *t;
+    long n;
 
     if (!selmon->sel) return;
-    if (arg->i > 0) {
-        for (c = selmon->sel->next; c && !ISVISIBLE(c); c = c->next)
-            ;
-        if (!c)
-            for (c = selmon->clients; c && !ISVISIBLE(c); c = c->next)
+    for (c = selmon->sel, n = labs(arg->i); c && n > 0; c = t, n--) {
+        t = NULL;
+        if (arg->i > 0) {
+            for (t = c->next; t && !ISVISIBLE(t); t = t->next)
                 ;
-    } else {
-        for (i = selmon->clients; i != selmon->sel; i = i->next)
-            if (ISVISIBLE(i)) c = i;
-        if (!c)
-            for (; i; i = i->next)
-                if (ISVISIBLE(i)) c = i;
+            if (!t)
+                for (t = selmon->clients; t && !ISVISIBLE(t); t = t->next)
+                    ;
+        } else {
+            for (i = selmon->clients; i != c; i = i->next)
+                if (ISVISIBLE(i)) t = i;
+            if (!t)
+                for (; i; i = i->next)
+                    if (ISVISIBLE(i)) t = i;
+        }
     }
     if (c) {
         focus(c);
@@ -795,19 +1417,40 @@ void focusstack(const Arg *arg) {
     }
 }
 
-Atom getatomprop(Client *c, Atom prop) {
-    int di;
-    unsigned long dl;
-    unsigned char *p = NULL;
-    Atom da, atom = None;
+Atom getatomreply(xcb_get_property_cookie_t ck) {
+    xcb_get_property_reply_t *r = getpropreply(ck);
+    Atom atom = None;
 
-    if (XGetWindowProperty(dpy, c->win, prop, 0L, sizeof atom, False, XA_ATOM, &da, &di, &dl, &dl, &p) == Success && p) {
-        atom = *(Atom *)p;
-        XFree(p);
+    if (r) {
+        atom = *(xcb_atom_t *)xcb_get_property_value(r);
+        free(r);
     }
     return atom;
 }
 
+long long getms() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* Requests up to words 32 bit units of prop without waiting for them, the
+ * reply is collected with getpropreply(). */
+xcb_get_property_cookie_t getprop(Window w, Atom prop, Atom type, uint32_t words) {
+    return xcb_get_property(xc, 0, w, prop, type, 0, words);
+}
+
+/* Returns the reply to free(3), or NULL if the window is gone or the
+ * property is unset or of another type. */
+xcb_get_property_reply_t *getpropreply(xcb_get_property_cookie_t ck) {
+    xcb_generic_error_t *e = NULL;
+    xcb_get_property_reply_t *r = xcb_get_property_reply(xc, ck, &e);
+
+    free(e);
+    return checkprop(r);
+}
+
 int getrootptr(int *x, int *y) {
     int di;
     unsigned int dui;
@@ -816,40 +1459,21 @@ int getrootptr(int *x, int *y) {
     return XQueryPointer(dpy, root, &dummy, &dummy, x, y, &di, &di, &dui);
 }
 
-long getstate(Window w) {
-    int format;
+/* Returns the WM_STATE of the reply to getprop(w, wmatom[WMState],
+ * wmatom[WMState], 2), or -1. */
+long getstatereply(xcb_get_property_cookie_t ck) {
+    xcb_get_property_reply_t *r = getpropreply(ck);
     long result = -1;
-    unsigned char *p = NULL;
-    unsigned long n, extra;
-    Atom real;
-
-    if (XGetWindowProperty(dpy, w, wmatom[WMState], 0L, 2L, False, wmatom[WMState], &real, &format, &n, &extra, (unsigned char **)&p)
-        != Success)
-        return -1;
-    if (n != 0) result = *p;
-    XFree(p);
+
+    if (r) {
+        result = *(uint32_t *)xcb_get_property_value(r);
+        free(r);
+    }
     return result;
 }
 
 int gettextprop(Window w, Atom atom, char *text, unsigned int size) {
-    char **list = NULL;
-    int n;
-    XTextProperty name;
-
-    if (!text || size == 0) return 0;
-    text[0] = '\0';
-    if (!XGetTextProperty(dpy, w, &name, atom) || !name.nitems) return 0;
-    if (name.encoding == XA_STRING)
-        strncpy(text, (char *)name.value, size - 1);
-    else {
-        if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
-            strncpy(text, *list, size - 1);
-            XFreeStringList(list);
-        }
-    }
-    text[size - 1] = '\0';
-    XFree(name.value);
-    return 1;
+    return replytext(getpropreply(getprop(w, atom, XCB_GET_PROPERTY_TYPE_ANY, size)), text, size);
 }
 
 void grabbuttons(Client *c, int focused) {
@@ -882,11 +1506,87 @@ void grabkeys() {
     }
 }
 
+/* Input may pass what doesn't change what it acts on, a key press doesn't
+ * wait for the configure requests and property changes read before it.
+ * Anything else, a map or a focus change for instance, is a barrier input
+ * doesn't cross. */
+static int isinput(XEvent *ev) { return ev->type >= KeyPress && ev->type <= MotionNotify; }
+
+static int isbarrier(XEvent *ev) {
+    switch (ev->type) {
+    case ConfigureNotify:
+        return ev->xconfigure.window == root;
+    case ConfigureRequest:
+    case Expose:
+    case PropertyNotify:
+        return 0;
+    default:
+        return ev->type < LASTEvent && !isinput(ev);
+    }
+}
+
+/* Handles the batch, input first between barriers. Handlers may take the
+ * rest of the batch back with pauseevents(). */
+void handlebatch() {
+    int i, start, end, pass;
+
+    mergebatch();
+    for (start = 0; running && start < nbatch; start = end + 1) {
+        for (end = start; end < nbatch - 1 && !isbarrier(&batch[end]); end++)
+            ;
+        for (pass = 0; pass < 2; pass++)
+            for (i = start; running && i <= end && i < nbatch; i++) {
+                if (batchdone[i] || isinput(&batch[i]) != !pass) continue;
+                batchdone[i] = 1;
+#ifdef XREADER
+                /* time spent queued behind dwm, longer than a frame is worth a note */
+                if (readerfd >= 0 && reader_now() - batchwhen[i] > 16000)
+                    DEBUG("dwm: event %d waited %lld us\n", batch[i].type, reader_now() - batchwhen[i]);
+#endif
+                handleevent(&batch[i]);
+            }
+    }
+    nbatch = 0;
+    flushrepeat();
+}
+
+void handleevent(XEvent *ev) {
+#ifdef OVERVIEW
+    if (thumbs && thumb_event(ev)) return;
+#endif
+#ifdef COMPOSITOR
+    if (compositing && comp_event(ev)) return;
+#endif
+    if (ev->type == syncevbase + XSyncAlarmNotify)
+        idlealarm((XSyncAlarmNotifyEvent *)ev);
+    else if (ev->type < LASTEvent && handler[ev->type])
+        handler[ev->type](ev); /* call handler */
+}
+
+void idlealarm(XSyncAlarmNotifyEvent *ev) {
+    XSyncAlarmAttributes attr;
+    int back = ev->alarm == idlealarms[1];
+
+    if (ev->alarm != idlealarms[0] && !back) return;
+    useridle = !back;
+    if (useridle) postidle(IdleFontCache);
+    /* an alarm that fired is inactive, rearm the other one */
+    XSyncIntToValue(&attr.trigger.wait_value, back ? idletimeout : idletimeout - 1);
+    XSyncChangeAlarm(dpy, idlealarms[back ? 0 : 1], XSyncCAValue, &attr);
+}
+
 void incnmaster(const Arg *arg) {
     selmon->nmaster = MAX(selmon->nmaster + arg->i, 0);
     arrange(selmon);
 }
 
+void indexclient(Client *c) {
+    char text[sizeof c->name + sizeof c->class + 1];
+
+    snprintf(text, sizeof text, "%s %s", c->name, c->class);
+    tri_set(titleindex, c->slot, text);
+}
+
 static int isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info) {
     while (n--)
         if (unique[n].x_org == info->x_org && unique[n].y_org == info->y_org && unique[n].width == info->width
@@ -897,13 +1597,21 @@ static int isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo
 
 void keypress(XEvent *e) {
     unsigned int i;
+    int repeat;
     KeySym keysym;
     XKeyEvent *ev;
 
     ev = &e->xkey;
+    /* with detectable autorepeat a held key repeats presses alone */
+    repeat = ev->keycode == heldkey;
+    heldkey = ev->keycode;
     keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
     for (i = 0; i < LENGTH(keys); i++)
-        if (keysym == keys[i].keysym && CLEANMASK(keys[i].mod) == CLEANMASK(ev->state) && keys[i].func) keys[i].func(&(keys[i].arg));
+        if (keysym == keys[i].keysym && CLEANMASK(keys[i].mod) == CLEANMASK(ev->state) && keys[i].func) {
+            if (repeat && sumrepeat(&keys[i])) continue;
+            flushrepeat();
+            keys[i].func(&(keys[i].arg));
+        }
 }
 
 void killclient(const Arg *arg) {
@@ -919,6 +1627,17 @@ void killclient(const Arg *arg) {
     }
 }
 
+void launcher(const Arg *arg) {
+    char input[256] = "";
+    int i = prompt(&launchprompt, input, sizeof input);
+
+    if (i >= 0)
+        launch_run(i);
+    else if (i == PromptInput && input[0])
+        launch_shell(input);
+    postidle(IdleLaunchCounts);
+}
+
 void manage(Window w, XWindowAttributes *wa) {
     Client *c, *t = NULL;
     Window trans = None;
@@ -926,6 +1645,14 @@ void manage(Window w, XWindowAttributes *wa) {
 
     c = ecalloc(1, sizeof(Client));
     c->win = w;
+    for (c->slot = 0; c->slot < nslots && slots[c->slot]; c->slot++)
+        ;
+    if (c->slot == nslots) {
+        if (!(slots = realloc(slots, (nslots + 64) * sizeof(Client *)))) die("realloc:");
+        memset(slots + nslots, 0, 64 * sizeof(Client *));
+        nslots += 64;
+    }
+    slots[c->slot] = c;
     /* geometry */
     c->x = c->oldx = wa->x;
     c->y = c->oldy = wa->y;
@@ -941,6 +1668,9 @@ void manage(Window w, XWindowAttributes *wa) {
         c->mon = selmon;
         applyrules(c);
     }
+    indexclient(c);
+    c->desktop = -2;
+    updatedesktop(c);
 
     if (c->x + WIDTH(c) > c->mon->mx + c->mon->mw) c->x = c->mon->mx + c->mon->mw - WIDTH(c);
     if (c->y + HEIGHT(c) > c->mon->my + c->mon->mh) c->y = c->mon->my + c->mon->mh - HEIGHT(c);
@@ -959,6 +1689,9 @@ void manage(Window w, XWindowAttributes *wa) {
     updatesizehints(c);
     updatewmhints(c);
     XSelectInput(dpy, w, EnterWindowMask | FocusChangeMask | PropertyChangeMask | StructureNotifyMask);
+#ifdef OVERVIEW
+    if (thumbs) thumb_redirect(w, 1);
+#endif
     grabbuttons(c, 0);
     if (!c->isfloating) c->isfloating = c->oldstate = trans != None || c->isfixed;
     if (c->isfloating) XRaiseWindow(dpy, c->win);
@@ -978,7 +1711,9 @@ void managealtbar(Window win, XWindowAttributes *wa) {
     Monitor *m;
     if (!(m = recttomon(wa->x, wa->y, wa->width, wa->height))) return;
 
+    if (m->barwin && !m->isaltbar) XDestroyWindow(dpy, m->barwin);
     m->barwin = win;
+    m->isaltbar = 1;
     m->by = wa->y;
     bh = m->bh = wa->height;
     updatebarpos(m);
@@ -1008,6 +1743,87 @@ void maprequest(XEvent *e) {
         manage(ev->window, &wa);
 }
 
+/* Drops property changes a later change of the same property in the
+ * batch supersedes, propertynotify() reads the latest value anyway.
+ * Folds configure requests of a window into the next one of it, up to
+ * the next barrier. Each costs a round trip in configurerequest(). Border
+ * widths and stacking are left alone, they aren't merely overwritten. */
+void mergebatch() {
+    XConfigureRequestEvent *a, *b;
+    XPropertyEvent *p, *q;
+    int i, j, nprops = 0, nconfs = 0;
+
+    for (i = 0; i < nbatch; i++) {
+        if (batch[i].type != PropertyNotify) continue;
+        p = &batch[i].xproperty;
+        for (j = i + 1; j < nbatch; j++) {
+            q = &batch[j].xproperty;
+            /* a deletion is ignored, the change before it is not */
+            if (batch[j].type == PropertyNotify && q->window == p->window && q->atom == p->atom && q->state == PropertyNewValue) {
+                batchdone[i] = 1;
+                nprops++;
+                break;
+            }
+        }
+    }
+    for (i = 0; i < nbatch; i++) {
+        a = &batch[i].xconfigurerequest;
+        if (batch[i].type != ConfigureRequest || a->value_mask & ~(CWX | CWY | CWWidth | CWHeight)) continue;
+        for (j = i + 1; j < nbatch && !isbarrier(&batch[j]); j++) {
+            b = &batch[j].xconfigurerequest;
+            if (batch[j].type != ConfigureRequest || b->window != a->window) continue;
+            if (b->value_mask & ~(CWX | CWY | CWWidth | CWHeight)) break;
+            if (!(b->value_mask & CWX)) b->x = a->x;
+            if (!(b->value_mask & CWY)) b->y = a->y;
+            if (!(b->value_mask & CWWidth)) b->width = a->width;
+            if (!(b->value_mask & CWHeight)) b->height = a->height;
+            b->value_mask |= a->value_mask;
+            batchdone[i] = 1;
+            nconfs++;
+            break;
+        }
+    }
+    merged += nprops + nconfs;
+    if (nprops || nconfs)
+        DEBUG("dwm: batch of %d merged %d property changes and %d configure requests, %lu so far\n", nbatch, nprops, nconfs, merged);
+}
+
+/* Handles what modal loops like overview() and prompt() read besides input
+ * and returns 1 if their window win has to be redrawn. */
+int modalevent(XEvent *ev, Window win) {
+    switch (ev->type) {
+    case ConfigureRequest:
+    case MapRequest:
+        handler[ev->type](ev);
+        break;
+    case Expose:
+        if (ev->xexpose.window == win) return 1;
+        handler[ev->type](ev);
+        break;
+    default:
+        /* the user coming back presses a key, which may open the loop */
+        if (ev->type == syncevbase + XSyncAlarmNotify) {
+            idlealarm((XSyncAlarmNotifyEvent *)ev);
+            break;
+        }
+#ifdef OVERVIEW
+        if (thumbs && thumb_event(ev)) return 1;
+#endif
+#ifdef COMPOSITOR
+        if (compositing) comp_event(ev);
+#endif
+        break;
+    }
+    return 0;
+}
+
+/* Modal loops read input, the requests dwm must keep answering and
+ * extension events, everything else waits until they end. */
+Bool modalpredicate(Display *dpy, XEvent *ev, XPointer arg) {
+    return ev->type == KeyPress || ev->type == ButtonPress || ev->type == ConfigureRequest || ev->type == MapRequest
+           || ev->type == Expose || ev->type >= LASTEvent;
+}
+
 void motionnotify(XEvent *e) {
     static Monitor *mon = NULL;
     Monitor *m;
@@ -1038,6 +1854,7 @@ void movemouse(const Arg *arg) {
     if (XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync, None, cursor[CurMove]->cursor, CurrentTime) != GrabSuccess)
         return;
     if (!getrootptr(&x, &y)) return;
+    pauseevents();
     do {
         XMaskEvent(dpy, MOUSEMASK | ExposureMask | SubstructureRedirectMask, &ev);
         switch (ev.type) {
@@ -1063,10 +1880,14 @@ void movemouse(const Arg *arg) {
             if (!c->isfloating && (abs(nx - c->x) > snap || abs(ny - c->y) > snap))
                 togglefloating(NULL);
             if (c->isfloating) resize(c, nx, ny, c->w, c->h, 1);
+#ifdef COMPOSITOR
+            if (compositing) comp_sync();
+#endif
             break;
         }
     } while (ev.type != ButtonRelease);
     XUngrabPointer(dpy, CurrentTime);
+    resumeevents();
     if ((m = recttomon(c->x, c->y, c->w, c->h)) != selmon) {
         sendmon(c, m);
         selmon = m;
@@ -1074,12 +1895,202 @@ void movemouse(const Arg *arg) {
     }
 }
 
+void moveresizeclient(Client *c, int x, int y, int w, int h) {
+    XWindowChanges wc;
+
+    c->oldx = c->x;
+    c->x = wc.x = x;
+    c->oldy = c->y;
+    c->y = wc.y = y;
+    c->oldw = c->w;
+    c->w = wc.width = w;
+    c->oldh = c->h;
+    c->h = wc.height = h;
+    wc.border_width = c->bw;
+    XConfigureWindow(dpy, c->win, CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &wc);
+    configure(c);
+}
+
+/* Orders index slots by the last focus of their clients, newest first,
+ * with the focused client last. */
+int mrucmp(const void *a, const void *b) {
+    const Client *ca = slots[*(const unsigned int *)a], *cb = slots[*(const unsigned int *)b];
+    unsigned long fa = ca == selmon->sel ? 0 : ca->lastfocus, fb = cb == selmon->sel ? 0 : cb->lastfocus;
+
+    return fa < fb ? 1 : fa > fb ? -1 : 0;
+}
+
+/* Continues a title change once _NET_WM_NAME arrived, WM_NAME is only
+ * asked for if it's unset. */
+void nettitlereply(void *reply, void *arg) {
+    Client *c = arg;
+
+    if (replytext(checkprop(reply), c->name, sizeof c->name))
+        titlereply(NULL, c);
+    else
+        async_await(c->win, getprop(c->win, XA_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, sizeof c->name).sequence, titlereply, c);
+}
+
 Client *nexttiled(Client *c) {
     for (; c && (c->isfloating || !ISVISIBLE(c)); c = c->next)
         ;
     return c;
 }
 
+#ifdef OVERVIEW
+/* Shows thumbnails of all clients of all monitors on the selected one,
+ * most recently focused first, and focuses the chosen one. */
+void overview(const Arg *arg) {
+    Monitor *m = selmon, *mon;
+    Client *c, **cs;
+    XSetWindowAttributes wa = {.override_redirect = True, .event_mask = ExposureMask};
+    XEvent ev;
+    Window win;
+    Arg a;
+    int i, n = 0, sel = 0, cols, rows, redraw = 1, done = 0;
+
+    if (!thumbs) return;
+    for (mon = mons; mon; mon = mon->next)
+        for (c = mon->stack; c; c = c->snext) n++;
+    if (!n) return;
+    cs = ecalloc(n, sizeof(Client *));
+    for (c = m->stack, n = 0; c; c = c->snext) cs[n++] = c;
+    for (mon = mons; mon; mon = mon->next)
+        for (c = mon->stack; c && mon != m; c = c->snext) cs[n++] = c;
+    for (cols = 1; cols * cols < n; cols++)
+        ;
+    rows = (n + cols - 1) / cols;
+    win = XCreateWindow(dpy, root, m->mx, m->my, m->mw, m->mh, 0, DefaultDepth(dpy, screen), CopyFromParent, DefaultVisual(dpy, screen),
+                        CWOverrideRedirect | CWEventMask, &wa);
+    XMapRaised(dpy, win);
+#ifdef COMPOSITOR
+    if (compositing) comp_showwindow(win);
+#endif
+    if (XGrabKeyboard(dpy, root, True, GrabModeAsync, GrabModeAsync, CurrentTime) != GrabSuccess) {
+        sel = -1;
+        done = 1;
+    }
+    XGrabPointer(dpy, root, False, ButtonPressMask, GrabModeAsync, GrabModeAsync, None, cursor[CurNormal]->cursor, CurrentTime);
+    sizedrw(m->mh);
+    pauseevents();
+    while (!done) {
+        if (!XCheckIfEvent(dpy, &ev, modalpredicate, NULL)) {
+            if (redraw) overviewdraw(win, m, cs, n, sel, cols);
+            redraw = 0;
+#ifdef COMPOSITOR
+            if (compositing) comp_sync();
+#endif
+            XIfEvent(dpy, &ev, modalpredicate, NULL);
+        }
+        switch (ev.type) {
+        case KeyPress:
+            switch (XKeycodeToKeysym(dpy, (KeyCode)ev.xkey.keycode, 0)) {
+            case XK_Escape:
+                sel = -1; /* fallthrough */
+            case XK_Return:
+            case XK_space:
+                done = 1;
+                break;
+            case XK_Left:
+            case XK_h:
+                sel = (sel + n - 1) % n;
+                break;
+            case XK_Right:
+            case XK_l:
+            case XK_Tab:
+                sel = (sel + 1) % n;
+                break;
+            case XK_Up:
+            case XK_k:
+                if (sel >= cols) sel -= cols;
+                break;
+            case XK_Down:
+            case XK_j:
+                if (sel + cols < n) sel += cols;
+                break;
+            }
+            redraw = 1;
+            break;
+        case ButtonPress:
+            i = (ev.xbutton.y_root - m->my) * rows / m->mh * cols + (ev.xbutton.x_root - m->mx) * cols / m->mw;
+            sel = ev.xbutton.button == Button1 && i >= 0 && i < n ? i : -1;
+            done = 1;
+            break;
+        default:
+            /* thumbnails that changed are rescaled by the next draw */
+            redraw |= modalevent(&ev, win);
+        }
+    }
+    resumeevents();
+    XUngrabPointer(dpy, CurrentTime);
+    XUngrabKeyboard(dpy, CurrentTime);
+    XDestroyWindow(dpy, win);
+    sizedrw(bh);
+    if (sel >= 0) {
+        c = cs[sel];
+        if (c->mon != selmon) {
+            unfocus(selmon->sel, 0);
+            selmon = c->mon;
+        }
+        if (!ISVISIBLE(c)) {
+            a.ui = c->tags;
+            view(&a);
+        }
+        focus(c);
+        restack(selmon);
+    }
+    free(cs);
+}
+
+void overviewdraw(Window win, Monitor *m, Client **cs, int n, int sel, int cols) {
+    int i, x, y, th = drw->fonts->h + 2;
+    int cw = m->mw / cols, ch = m->mh / ((n + cols - 1) / cols);
+    unsigned int w, h;
+    Picture p;
+
+    drw_setscheme(drw, scheme[SchemeNorm]);
+    drw_rect(drw, 0, 0, m->mw, m->mh, 1, 1);
+    for (i = 0; i < n; i++) {
+        x = i % cols * cw;
+        y = i / cols * ch;
+        if ((p = thumb_get(cs[i]->win, MAX(cw - 2 * (int)gappx, 1), MAX(ch - 3 * (int)gappx - th, 1), &w, &h)))
+            drw_picture(drw, p, x + (cw - w) / 2, y + gappx, w, h);
+        drw_setscheme(drw, scheme[i == sel ? SchemeSel : SchemeNorm]);
+        drw_text(drw, x + gappx, y + ch - gappx - th, cw - 2 * gappx, th, lrpad / 2, cs[i]->name, 0);
+    }
+    drw_map(drw, win, 0, 0, m->mw, m->mh);
+}
+
+#endif
+
+/* Gives the events read ahead back to Xlib for code reading events
+ * itself, until resumeevents(). */
+void pauseevents() {
+    int i;
+
+    eventspaused++;
+#ifdef XREADER
+    reader_pause();
+#endif
+    /* newest first, they're older than what the reader gave back */
+    for (i = nbatch - 1; i >= 0; i--)
+        if (!batchdone[i]) XPutBackEvent(dpy, &batch[i]);
+    nbatch = 0;
+}
+
+/* Records the geometry c gets from a layout if it changes and returns its
+ * outer height. */
+int place(Monitor *m, Client *c, int x, int y, int w, int h) {
+    if (applysizehints(c, &x, &y, &w, &h, 0)) {
+        m->placed[m->nplaced].c = c;
+        m->placed[m->nplaced].x = x;
+        m->placed[m->nplaced].y = y;
+        m->placed[m->nplaced].w = w;
+        m->placed[m->nplaced++].h = h;
+    }
+    return h + 2 * c->bw;
+}
+
 void pop(Client *c) {
     detach(c);
     attach(c);
@@ -1087,12 +2098,144 @@ void pop(Client *c) {
     arrange(c->mon);
 }
 
+void postidle(int task) { idlepending |= 1 << task; }
+
+/* Reads a line on top of the selected monitor and lists below it what
+ * p->filter returns for it. Returns the chosen item, PromptInput when
+ * Return is pressed with Shift or nothing listed, or PromptCancel. */
+int prompt(const Prompt *p, char *input, size_t size) {
+    XSetWindowAttributes wa = {.override_redirect = True, .event_mask = ExposureMask};
+    unsigned int items[32];
+    size_t len = strlen(input), n, max = MIN(promptlines, LENGTH(items));
+    int i, sel = 0, redraw = 1, ret = PromptCancel, done = 0, changed;
+    int lineh = drw->fonts->h + 2;
+    char buf[32];
+    KeySym ks;
+    XEvent ev;
+
+    if (!promptwin)
+        promptwin = XCreateWindow(dpy, root, 0, 0, 1, 1, 0, DefaultDepth(dpy, screen), CopyFromParent, DefaultVisual(dpy, screen),
+                                  CWOverrideRedirect | CWEventMask, &wa);
+    XMoveResizeWindow(dpy, promptwin, selmon->mx, selmon->my, selmon->mw, (max + 1) * lineh);
+    XMapRaised(dpy, promptwin);
+#ifdef COMPOSITOR
+    if (compositing) comp_showwindow(promptwin);
+#endif
+    if (XGrabKeyboard(dpy, root, True, GrabModeAsync, GrabModeAsync, CurrentTime) != GrabSuccess) done = 1;
+    XGrabPointer(dpy, root, False, ButtonPressMask, GrabModeAsync, GrabModeAsync, None, cursor[CurNormal]->cursor, CurrentTime);
+    n = p->filter(input, items, max);
+    sizedrw((max + 1) * lineh);
+    pauseevents();
+    while (!done) {
+        if (!XCheckIfEvent(dpy, &ev, modalpredicate, NULL)) {
+            if (redraw) promptdraw(p, input, items, n, max, sel);
+            redraw = 0;
+#ifdef COMPOSITOR
+            if (compositing) comp_sync();
+#endif
+            XIfEvent(dpy, &ev, modalpredicate, NULL);
+        }
+        switch (ev.type) {
+        case KeyPress:
+            changed = 0;
+            i = XLookupString(&ev.xkey, buf, sizeof buf, &ks, NULL);
+            if (ev.xkey.state & ControlMask) {
+                switch (ks) {
+                case XK_u:
+                    input[len = 0] = '\0';
+                    changed = 1;
+                    break;
+                case XK_h:
+                    ks = XK_BackSpace;
+                    break;
+                case XK_n:
+                    ks = XK_Down;
+                    break;
+                case XK_p:
+                    ks = XK_Up;
+                    break;
+                }
+            }
+            switch (ks) {
+            case XK_Escape:
+                done = 1;
+                break;
+            case XK_Return:
+            case XK_KP_Enter:
+                ret = (ev.xkey.state & ShiftMask) || !n ? PromptInput : (int)items[sel];
+                done = 1;
+                break;
+            case XK_Up:
+            case XK_ISO_Left_Tab:
+                if (sel > 0) sel--;
+                break;
+            case XK_Down:
+            case XK_Tab:
+                if (sel + 1 < (int)n) sel++;
+                break;
+            case XK_BackSpace:
+                /* drop a whole UTF-8 sequence */
+                while (len && (input[--len] & 0xc0) == 0x80)
+                    ;
+                input[len] = '\0';
+                changed = 1;
+                break;
+            default:
+                if (i > 0 && !iscntrl((unsigned char)buf[0]) && !(ev.xkey.state & ControlMask) && len + i < size) {
+                    memcpy(input + len, buf, i);
+                    input[len += i] = '\0';
+                    changed = 1;
+                }
+            }
+            if (changed) {
+                n = p->filter(input, items, max);
+                sel = 0;
+            }
+            redraw = 1;
+            break;
+        case ButtonPress:
+            i = ev.xbutton.y_root - selmon->my;
+            if (ev.xbutton.button == Button1 && i >= lineh && i / lineh - 1 < (int)n) ret = items[i / lineh - 1];
+            done = 1;
+            break;
+        default:
+            redraw |= modalevent(&ev, promptwin);
+        }
+    }
+    resumeevents();
+    XUngrabPointer(dpy, CurrentTime);
+    XUngrabKeyboard(dpy, CurrentTime);
+    XUnmapWindow(dpy, promptwin);
+    sizedrw(bh);
+    return ret;
+}
+
+void promptdraw(const Prompt *p, const char *input, unsigned int *items, size_t n, size_t lines, int sel) {
+    int x, w = selmon->mw, lineh = drw->fonts->h + 2;
+    size_t i;
+
+    drw_setscheme(drw, scheme[SchemeSel]);
+    x = drw_text(drw, 0, 0, TEXTW(p->label), lineh, lrpad / 2, p->label, 0);
+    drw_setscheme(drw, scheme[SchemeNorm]);
+    drw_text(drw, x, 0, w - x, lineh, lrpad / 2, input, 0);
+    drw_rect(drw, MIN(x + (int)TEXTW(input) - lrpad / 2, w - 2), 2, 2, lineh - 4, 1, 0); /* cursor */
+    for (i = 0; i < n; i++) {
+        drw_setscheme(drw, scheme[(int)i == sel ? SchemeSel : SchemeNorm]);
+        drw_text(drw, 0, (i + 1) * lineh, w, lineh, lrpad / 2, p->text(items[i]), 0);
+    }
+    drw_setscheme(drw, scheme[SchemeNorm]);
+    drw_rect(drw, 0, (n + 1) * lineh, w, (lines - n) * lineh, 1, 1);
+    drw_map(drw, promptwin, 0, 0, w, (lines + 1) * lineh);
+}
+
 void propertynotify(XEvent *e) {
     Client *c;
     Window trans;
     XPropertyEvent *ev = &e->xproperty;
 
-    if (ev->state == PropertyDelete)
+    if ((ev->window == root) && (ev->atom == XA_WM_NAME))
+        updatestatus();
+    else if (ev->state == PropertyDelete)
         return; /* ignore */
     else if ((c = wintoclient(ev->window))) {
         switch (ev->atom) {
@@ -1103,21 +2246,61 @@ void propertynotify(XEvent *e) {
                 arrange(c->mon);
             break;
         case XA_WM_NORMAL_HINTS:
-            updatesizehints(c);
+            async_await(c->win, getprop(c->win, XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS, 18).sequence, sizehintsreply, c);
             break;
         case XA_WM_HINTS:
             updatewmhints(c);
+            drawbars();
             break;
         }
-        if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
-            updatetitle(c);
-        }
+        if ((ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) && gameclient) {
+            c->dirtytitle = 1;
+            deferred |= DeferTitles;
+        } else if ((ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) && fetchfd >= 0)
+            fetch_post(c->win, FetchTitle);
+        else if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName])
+            /* a client slow to answer doesn't hold up the others */
+            async_await(c->win, getprop(c->win, netatom[NetWMName], XCB_GET_PROPERTY_TYPE_ANY, sizeof c->name).sequence,
+                        nettitlereply, c);
+        if (ev->atom == XA_WM_CLASS && fetchfd >= 0) fetch_post(c->win, FetchClass);
         if (ev->atom == netatom[NetWMWindowType]) updatewindowtype(c);
     }
 }
 
 void quit(const Arg *arg) { running = 0; }
 
+/* Status daemons write lines to the status FIFO. A line of the form
+ * id=text replaces the segment id and leaves the others alone, any other
+ * line replaces the whole status text. */
+void readstatus(int fd) {
+    static char buf[1024];
+    static size_t len;
+    char *line, *nl, *eq;
+    ssize_t n;
+
+    while ((n = read(fd, buf + len, sizeof buf - 1 - len)) > 0) {
+        len += n;
+        buf[len] = '\0';
+        for (line = buf; (nl = strchr(line, '\n')); line = nl + 1) {
+            *nl = '\0';
+            eq = line + strspn(line, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-");
+            if (*eq == '=' && eq != line && eq - line < (int)sizeof segments[0].id) {
+                *eq = '\0';
+                rawstatus = 0;
+                setsegment(line, eq + 1);
+            } else {
+                rawstatus = 1;
+                nsegments = 0;
+                strncpy(stext, line, sizeof stext - 1);
+            }
+        }
+        /* keep a partial line for the next read, drop it if it can't fit */
+        len = line == buf && len == sizeof buf - 1 ? 0 : buf + len - line;
+        memmove(buf, line, len);
+    }
+    drawbar(selmon);
+}
+
 Monitor *recttomon(int x, int y, int w, int h) {
     Monitor *m, *r = selmon;
     int a, area = 0;
@@ -1130,24 +2313,47 @@ Monitor *recttomon(int x, int y, int w, int h) {
     return r;
 }
 
+/* Stores the text of the property reply r, which may be NULL, in text and
+ * frees r. Returns 0 if there was none. */
+int replytext(xcb_get_property_reply_t *r, char *text, unsigned int size) {
+    char **list = NULL;
+    int n, len;
+    XTextProperty name;
+
+    if (!text || size == 0) {
+        free(r);
+        return 0;
+    }
+    text[0] = '\0';
+    if (!r) return 0;
+    len = xcb_get_property_value_length(r);
+    if (r->type == XA_STRING) {
+        /* not terminated in the reply */
+        len = MIN((unsigned int)len, size - 1);
+        memcpy(text, xcb_get_property_value(r), len);
+        text[len] = '\0';
+    } else {
+        /* only the conversion to the locale is left to Xlib, it needs no round trip */
+        name.value = xcb_get_property_value(r);
+        name.encoding = r->type;
+        name.format = r->format;
+        name.nitems = len / (r->format / 8);
+        if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
+            strncpy(text, *list, size - 1);
+            XFreeStringList(list);
+        }
+    }
+    text[size - 1] = '\0';
+    free(r);
+    return 1;
+}
+
 void resize(Client *c, int x, int y, int w, int h, int interact) {
     if (applysizehints(c, &x, &y, &w, &h, interact)) resizeclient(c, x, y, w, h);
 }
 
 void resizeclient(Client *c, int x, int y, int w, int h) {
-    XWindowChanges wc;
-
-    c->oldx = c->x;
-    c->x = wc.x = x;
-    c->oldy = c->y;
-    c->y = wc.y = y;
-    c->oldw = c->w;
-    c->w = wc.width = w;
-    c->oldh = c->h;
-    c->h = wc.height = h;
-    wc.border_width = c->bw;
-    XConfigureWindow(dpy, c->win, CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &wc);
-    configure(c);
+    moveresizeclient(c, x, y, w, h);
     XSync(dpy, False);
 }
 
@@ -1168,6 +2374,7 @@ void resizemouse(const Arg *arg) {
         != GrabSuccess)
         return;
     XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
+    pauseevents();
     do {
         XMaskEvent(dpy, MOUSEMASK | ExposureMask | SubstructureRedirectMask, &ev);
         switch (ev.type) {
@@ -1188,6 +2395,9 @@ void resizemouse(const Arg *arg) {
                     togglefloating(NULL);
             }
             if (c->isfloating) resize(c, c->x, c->y, nw, nh, 1);
+#ifdef COMPOSITOR
+            if (compositing) comp_sync();
+#endif
             break;
         }
     } while (ev.type != ButtonRelease);
@@ -1195,6 +2405,7 @@ void resizemouse(const Arg *arg) {
     XUngrabPointer(dpy, CurrentTime);
     while (XCheckMaskEvent(dpy, EnterWindowMask, &ev))
         ;
+    resumeevents();
     if ((m = recttomon(c->x, c->y, c->w, c->h)) != selmon) {
         sendmon(c, m);
         selmon = m;
@@ -1204,21 +2415,75 @@ void resizemouse(const Arg *arg) {
 
 void restack(Monitor *m) {
     XEvent ev;
+    int i;
 
     if (!m->sel) return;
     if (m->sel->isfloating) XRaiseWindow(dpy, m->sel->win);
+    /* runs for every map and focus change, so the batch stays where it is
+     * instead of going back through pauseevents(), only its crossings go */
+    for (i = 0; i < nbatch; i++)
+        if (batch[i].type == EnterNotify) batchdone[i] = 1;
+#ifdef XREADER
+    reader_pause();
+#endif
     XSync(dpy, False);
     while (XCheckMaskEvent(dpy, EnterWindowMask, &ev))
         ;
+#ifdef XREADER
+    reader_resume();
+#endif
+}
+
+void resumeevents() {
+    eventspaused--;
+#ifdef XREADER
+    reader_resume();
+#endif
 }
 
 void run() {
-    XEvent ev;
+    struct pollfd pfd[LENGTH(watches) + 1];
+    int i;
 
     XSync(dpy, False);
-	while (running && !XNextEvent(dpy, &ev))
-	    if (handler[ev.type])
-			handler[ev.type](&ev); /* call handler */
+    while (running) {
+        /* drain everything already read before flushing our requests once */
+        while (running && fillbatch()) handlebatch();
+        async_dispatch();
+#ifdef PACING
+        if (pacing) commitlayouts();
+#endif
+        runidle();
+#ifdef COMPOSITOR
+        if (compositing) comp_paint();
+#endif
+        XFlush(dpy);
+        /* XFlush() leaves requests sent through XCB alone if Xlib had none */
+        xcb_flush(xc);
+        if (!running) break;
+
+        if (eventspending() || async_ready()) continue;
+#ifdef PACING
+        if (pacing && pace_ready()) continue;
+#endif
+#ifdef XREADER
+        if (readerfd >= 0)
+            pfd[0].fd = readerfd;
+        else
+#endif
+            pfd[0].fd = ConnectionNumber(dpy);
+        pfd[0].events = POLLIN;
+        for (i = 0; i < nwatches; i++) {
+            pfd[i + 1].fd = watches[i].fd;
+            pfd[i + 1].events = POLLIN;
+        }
+        if (poll(pfd, nwatches + 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            die("poll:");
+        }
+        for (i = 0; i < nwatches; i++)
+            if (pfd[i + 1].revents) watches[i].func(watches[i].fd);
+    }
 }
 
 void runautostart() {
@@ -1249,26 +2514,120 @@ void runautostart() {
     free(user_config);
 }
 
-void scan() {
-    unsigned int i, num;
-    Window d1, d2, *wins = NULL;
-    XWindowAttributes wa;
-
-    if (XQueryTree(dpy, root, &d1, &d2, &wins, &num)) {
-        for (i = 0; i < num; i++) {
-            if (!XGetWindowAttributes(dpy, wins[i], &wa) || wa.override_redirect || XGetTransientForHint(dpy, wins[i], &d1)) continue;
-            if (wmclasscontains(wins[i], altbarclass, ""))
-                managealtbar(wins[i], &wa);
-            else if (wa.map_state == IsViewable || getstate(wins[i]) == IconicState)
-                manage(wins[i], &wa);
+/* Runs the idle tasks posted while no events wait, the heavy ones only
+ * once the user is idle. Each task is short, events are looked for in
+ * between. */
+void runidle() {
+    int i;
+
+    for (i = 0; i < IdleLast && idlepending; i++)
+        if (idlepending & 1 << i && (useridle || !idletasks[i].heavy)) {
+            if (eventspending()) return;
+            idlepending &= ~(1 << i);
+            idletasks[i].func();
+        }
+}
+
+void runmodule(Timer *t) {
+    const StatusModule *mod = &statusmodules[t - modtimer];
+    char buf[sizeof segments[0].text];
+
+    if (mod->func(buf, sizeof buf, mod->arg, &modstate[t - modtimer]) == 0) setsegment(mod->id, buf);
+}
+
+void runtimers(int fd) {
+    uint64_t ticks;
+    Timer *t, **tp, *due = NULL;
+
+    if (read(fd, &ticks, sizeof ticks) != sizeof ticks) return;
+    while (ticks--) {
+        wheelpos = (wheelpos + 1) % WHEELSLOTS;
+        for (tp = &wheel[wheelpos]; (t = *tp);) {
+            if (t->rounds) {
+                t->rounds--;
+                tp = &t->next;
+            } else {
+                *tp = t->next;
+                t->next = due;
+                due = t;
+            }
         }
-        for (i = 0; i < num; i++) { /* now the transients */
-            if (!XGetWindowAttributes(dpy, wins[i], &wa)) continue;
-            if (XGetTransientForHint(dpy, wins[i], &d1) && (wa.map_state == IsViewable || getstate(wins[i]) == IconicState))
-                manage(wins[i], &wa);
+    }
+    /* timers that were due several times over missed ticks run once */
+    while ((t = due)) {
+        due = t->next;
+        t->func(t);
+        addtimer(t);
+    }
+    /* modules only touched the segments, repaint what changed at once */
+    drawbar(selmon);
+}
+
+void savefontcache() { drw_fontcache_save(drw); }
+
+/* Asks for everything about all top level windows before waiting for the
+ * first reply, instead of a few round trips for each. */
+void scan() {
+    xcb_query_tree_reply_t *tree;
+    xcb_window_t *wins;
+    xcb_get_window_attributes_reply_t *a;
+    xcb_get_geometry_reply_t *g;
+    xcb_get_property_reply_t *p;
+    xcb_generic_error_t *e = NULL;
+    struct {
+        xcb_get_window_attributes_cookie_t attrck;
+        xcb_get_geometry_cookie_t geomck;
+        xcb_get_property_cookie_t transck, stateck;
+        XWindowAttributes wa;
+        int ok, istrans;
+        long state;
+    } *w;
+    int i, n;
+
+    if (!(tree = xcb_query_tree_reply(xc, xcb_query_tree(xc, root), &e))) {
+        free(e);
+        return;
+    }
+    wins = xcb_query_tree_children(tree);
+    n = xcb_query_tree_children_length(tree);
+    w = ecalloc(MAX(n, 1), sizeof *w);
+    for (i = 0; i < n; i++) {
+        w[i].attrck = xcb_get_window_attributes(xc, wins[i]);
+        w[i].geomck = xcb_get_geometry(xc, wins[i]);
+        w[i].transck = getprop(wins[i], XA_WM_TRANSIENT_FOR, XA_WINDOW, 1);
+        w[i].stateck = getprop(wins[i], wmatom[WMState], wmatom[WMState], 2);
+    }
+    for (i = 0; i < n; i++) {
+        a = xcb_get_window_attributes_reply(xc, w[i].attrck, &e);
+        free(e);
+        g = xcb_get_geometry_reply(xc, w[i].geomck, &e);
+        free(e);
+        if ((w[i].ok = a && g)) {
+            w[i].wa.x = g->x;
+            w[i].wa.y = g->y;
+            w[i].wa.width = g->width;
+            w[i].wa.height = g->height;
+            w[i].wa.border_width = g->border_width;
+            w[i].wa.map_state = a->map_state;
+            w[i].wa.override_redirect = a->override_redirect;
         }
-        if (wins) XFree(wins);
+        free(a);
+        free(g);
+        if ((p = getpropreply(w[i].transck))) w[i].istrans = 1;
+        free(p);
+        w[i].state = getstatereply(w[i].stateck);
+    }
+    for (i = 0; i < n; i++) {
+        if (!w[i].ok || w[i].wa.override_redirect || w[i].istrans) continue;
+        if (wmclasscontains(wins[i], altbarclass, ""))
+            managealtbar(wins[i], &w[i].wa);
+        else if (w[i].wa.map_state == IsViewable || w[i].state == IconicState)
+            manage(wins[i], &w[i].wa);
     }
+    for (i = 0; i < n; i++) /* now the transients */
+        if (w[i].ok && w[i].istrans && (w[i].wa.map_state == IsViewable || w[i].state == IconicState)) manage(wins[i], &w[i].wa);
+    free(w);
+    free(tree);
 }
 
 void sendmon(Client *c, Monitor *m) {
@@ -1278,12 +2637,45 @@ void sendmon(Client *c, Monitor *m) {
     detachstack(c);
     c->mon = m;
     c->tags = m->tagset[m->seltags]; /* assign tags of target monitor */
+    updatedesktop(c);
     attach(c);
     attachstack(c);
     focus(NULL);
     arrange(NULL);
 }
 
+/* Asks compositors to unredirect c while it is fullscreen. Rules turn this
+ * off for clients that misbehave unredirected, and a hint the client set
+ * itself is left alone. */
+void setbypass(Client *c, int bypass) {
+    long on = 1;
+    int di;
+    unsigned long n, dl;
+    unsigned char *p = NULL;
+    Atom da;
+
+    if (!c->bypass) return;
+    if (bypass && !c->ownbypass) {
+        if (XGetWindowProperty(dpy, c->win, netatom[NetWMBypassCompositor], 0L, 1L, False, XA_CARDINAL, &da, &di, &n, &dl, &p)
+                    == Success
+            && p) {
+            XFree(p);
+        } else
+            n = 0;
+        if (!n) XChangeProperty(dpy, c->win, netatom[NetWMBypassCompositor], XA_CARDINAL, 32, PropModeReplace, (unsigned char *)&on, 1);
+        c->ownbypass = !n;
+    } else if (!bypass && c->ownbypass) {
+        XDeleteProperty(dpy, c->win, netatom[NetWMBypassCompositor]);
+        c->ownbypass = 0;
+    }
+#ifdef COMPOSITOR
+    if (compositing) comp_setredirect(c->win, !bypass);
+#endif
+#ifdef OVERVIEW
+    if (thumbs) thumb_redirect(c->win, !bypass);
+#endif
+}
+
 void setclientstate(Client *c, long state) {
     long data[] = {state, None};
 
@@ -1291,23 +2683,25 @@ void setclientstate(Client *c, long state) {
 }
 
 int sendevent(Client *c, Atom proto) {
-    int n;
-    Atom *protocols;
-    int exists = 0;
-    XEvent ev;
-
-    if (XGetWMProtocols(dpy, c->win, &protocols, &n)) {
+    xcb_get_property_reply_t *r = getpropreply(getprop(c->win, wmatom[WMProtocols], XA_ATOM, 32));
+    xcb_client_message_event_t ev = {0};
+    xcb_atom_t *protocols;
+    int n, exists = 0;
+
+    if (r) {
+        protocols = xcb_get_property_value(r);
+        n = xcb_get_property_value_length(r) / sizeof(xcb_atom_t);
         while (!exists && n--) exists = protocols[n] == proto;
-        XFree(protocols);
+        free(r);
     }
     if (exists) {
-        ev.type = ClientMessage;
-        ev.xclient.window = c->win;
-        ev.xclient.message_type = wmatom[WMProtocols];
-        ev.xclient.format = 32;
-        ev.xclient.data.l[0] = proto;
-        ev.xclient.data.l[1] = CurrentTime;
-        XSendEvent(dpy, c->win, False, NoEventMask, &ev);
+        ev.response_type = XCB_CLIENT_MESSAGE;
+        ev.window = c->win;
+        ev.type = wmatom[WMProtocols];
+        ev.format = 32;
+        ev.data.data32[0] = proto;
+        ev.data.data32[1] = XCB_CURRENT_TIME;
+        xcb_send_event(xc, 0, c->win, XCB_EVENT_MASK_NO_EVENT, (const char *)&ev);
     }
     return exists;
 }
@@ -1328,11 +2722,18 @@ void setfullscreen(Client *c, int fullscreen) {
         c->oldbw = c->bw;
         c->bw = 0;
         c->isfloating = 1;
+        c->fstime = getms();
+        DEBUG("dwm: 0x%lx enters fullscreen at %lld ms\n", c->win, c->fstime);
         resizeclient(c, c->mon->mx, c->mon->my, c->mon->mw, c->mon->mh);
+        /* on top of everything, so compositors may unredirect it */
         XRaiseWindow(dpy, c->win);
+        setbypass(c, 1);
+        if (c == selmon->sel) setgamemode(c);
     } else if (!fullscreen && c->isfullscreen) {
         XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32, PropModeReplace, (unsigned char *)0, 0);
         c->isfullscreen = 0;
+        setbypass(c, 0);
+        DEBUG("dwm: 0x%lx leaves fullscreen after %lld ms\n", c->win, getms() - c->fstime);
         c->isfloating = c->oldstate;
         c->bw = c->oldbw;
         c->x = c->oldx;
@@ -1340,34 +2741,172 @@ void setfullscreen(Client *c, int fullscreen) {
         c->w = c->oldw;
         c->h = c->oldh;
         resizeclient(c, c->x, c->y, c->w, c->h);
+        if (c == gameclient) setgamemode(NULL);
         arrange(c->mon);
     }
 }
 
+/* Game mode sheds work while a fullscreen client has focus: the root stops
+ * reporting pointer motion and crossings, focus no longer follows the
+ * mouse, and titles, bars, the client list and arranges of the other
+ * monitors wait until it ends. */
+void setgamemode(Client *c) {
+    int di;
+    unsigned long n, dl;
+    unsigned char *p = NULL;
+    Atom da;
+    Monitor *m;
+    Client *i;
+
+    if (c == gameclient) return;
+    if (gamepid) setpriority(PRIO_PROCESS, gamepid, gameprio);
+    gamepid = 0;
+    if ((gameclient = c)) {
+        DEBUG("dwm: game mode for 0x%lx at %lld ms\n", c->win, getms());
+        XSelectInput(dpy, root, ROOTMASK & ~(PointerMotionMask | EnterWindowMask | LeaveWindowMask));
+        if (gamenice
+            && XGetWindowProperty(dpy, c->win, netatom[NetWMPid], 0L, 1L, False, XA_CARDINAL, &da, &di, &n, &dl, &p) == Success
+            && p) {
+            if (n) {
+                errno = 0;
+                gamepid = *(long *)p;
+                gameprio = getpriority(PRIO_PROCESS, gamepid);
+                if (errno || setpriority(PRIO_PROCESS, gamepid, gamenice) < 0) gamepid = 0;
+            }
+            XFree(p);
+        }
+        return;
+    }
+    DEBUG("dwm: game mode ends at %lld ms\n", getms());
+    XSelectInput(dpy, root, ROOTMASK);
+    if (deferred & DeferTitles)
+        for (m = mons; m; m = m->next)
+            for (i = m->clients; i; i = i->next)
+                if (i->dirtytitle) {
+                    if (fetchfd >= 0)
+                        fetch_post(i->win, FetchTitle);
+                    else
+                        updatetitle(i);
+                    i->dirtytitle = 0;
+                }
+    if (deferred & DeferClientList) updateclientlist();
+    if (deferred & DeferDesktops) {
+        for (m = mons; m; m = m->next)
+            for (i = m->clients; i; i = i->next) updatedesktop(i);
+        updatecurrentdesktop();
+    }
+    if (deferred & DeferArrange) arrange(NULL);
+    if (deferred & (DeferBars | DeferTitles)) drawbars();
+    deferred = 0;
+}
+
 /* arg > 1.0 will set mfact absolutely */
 void setmfact(const Arg *arg) {
     float f;
 
     if (!arg) return;
     f = arg->f < 1.0 ? arg->f + selmon->mfact : arg->f - 1.0;
-    if (f < 0.05 || f > 0.95) return;
+    /* summed repeats stop at the limit instead of missing it */
+    f = MAX(0.05, MIN(f, 0.95));
+    if (f == selmon->mfact) return;
     selmon->mfact = f;
     arrange(selmon);
 }
 
+void setsegment(const char *id, const char *text) {
+    int i;
+    size_t len;
+
+    for (i = 0; i < nsegments && strcmp(segments[i].id, id); i++)
+        ;
+    if (i == nsegments) {
+        if (nsegments == LENGTH(segments)) return;
+        strncpy(segments[nsegments++].id, id, sizeof segments[i].id - 1);
+    }
+    strncpy(segments[i].text, text, sizeof segments[i].text - 1);
+    /* modules keep their segments current without covering a whole status */
+    if (rawstatus) return;
+    for (i = 0, stext[0] = '\0'; i < nsegments; i++) {
+        len = strlen(stext);
+        snprintf(stext + len, sizeof stext - len, "%s%s", i ? statussep : "", segments[i].text);
+    }
+}
+
+/* Takes the WM_NORMAL_HINTS reply r, which may be NULL, and frees it. */
+void setsizehints(Client *c, xcb_get_property_reply_t *r) {
+    uint32_t v[18] = {PSize}; /* flags x y w h minw minh maxw maxh incw inch minax minay maxax maxay basew baseh gravity */
+    int n;
+
+    if (r) {
+        n = MIN(xcb_get_property_value_length(r) / 4, 18);
+        memcpy(v, xcb_get_property_value(r), n * 4);
+        /* pre-ICCCM clients end at the aspect ratios */
+        if (n < 18) v[0] &= ~(PBaseSize | PWinGravity);
+        free(r);
+    }
+    if (v[0] & PBaseSize) {
+        c->basew = v[15];
+        c->baseh = v[16];
+    } else if (v[0] & PMinSize) {
+        c->basew = v[5];
+        c->baseh = v[6];
+    } else
+        c->basew = c->baseh = 0;
+    if (v[0] & PResizeInc) {
+        c->incw = v[9];
+        c->inch = v[10];
+    } else
+        c->incw = c->inch = 0;
+    if (v[0] & PMaxSize) {
+        c->maxw = v[7];
+        c->maxh = v[8];
+    } else
+        c->maxw = c->maxh = 0;
+    if (v[0] & PMinSize) {
+        c->minw = v[5];
+        c->minh = v[6];
+    } else if (v[0] & PBaseSize) {
+        c->minw = v[15];
+        c->minh = v[16];
+    } else
+        c->minw = c->minh = 0;
+    if (v[0] & PAspect) {
+        c->mina = (float)(int32_t)v[12] / (int32_t)v[11];
+        c->maxa = (float)(int32_t)v[13] / (int32_t)v[14];
+    } else
+        c->maxa = c->mina = 0.0;
+    c->isfixed = (c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh);
+}
+
 void setup() {
+    unsigned int i;
     XSetWindowAttributes wa;
     Atom utf8string;
+    long ndesktops;
+    size_t len;
+    char *names, *p;
 
     /* clean up any zombies immediately */
     sigchld(0);
 
+    /* posix_spawn() in launch.c can't close it in the child like spawn() */
+    fcntl(ConnectionNumber(dpy), F_SETFD, FD_CLOEXEC);
+    xc = XGetXCBConnection(dpy);
+    async_init(xc);
+    /* titles are read on a connection of their own, see fetch.c */
+    if ((fetchfd = fetch_init(DisplayString(dpy))) >= 0) watchfd(fetchfd, fetchdone);
+
     /* init screen */
     screen = DefaultScreen(dpy);
     sw = DisplayWidth(dpy, screen);
     sh = DisplayHeight(dpy, screen);
     root = RootWindow(dpy, screen);
     drw = drw_create(dpy, screen, root, sw, sh);
+    if (!drw_fontset_create(drw, fonts, LENGTH(fonts))) die("no fonts could be loaded.");
+    lrpad = drw->fonts->h;
+    if (showbar) bh = drw->fonts->h + 2;
+    setupfontcache();
+    titleindex = tri_create();
     updategeom();
     /* init atoms */
     utf8string = XInternAtom(dpy, "UTF8_STRING", False);
@@ -1381,13 +2920,24 @@ void setup() {
     netatom[NetWMState] = XInternAtom(dpy, "_NET_WM_STATE", False);
     netatom[NetWMCheck] = XInternAtom(dpy, "_NET_SUPPORTING_WM_CHECK", False);
     netatom[NetWMFullscreen] = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
+    netatom[NetWMBypassCompositor] = XInternAtom(dpy, "_NET_WM_BYPASS_COMPOSITOR", False);
     netatom[NetWMWindowType] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
     netatom[NetWMWindowTypeDialog] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
     netatom[NetClientList] = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+    netatom[NetWMPid] = XInternAtom(dpy, "_NET_WM_PID", False);
+    netatom[NetNumberOfDesktops] = XInternAtom(dpy, "_NET_NUMBER_OF_DESKTOPS", False);
+    netatom[NetCurrentDesktop] = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False);
+    netatom[NetDesktopNames] = XInternAtom(dpy, "_NET_DESKTOP_NAMES", False);
+    netatom[NetWMDesktop] = XInternAtom(dpy, "_NET_WM_DESKTOP", False);
     /* init cursors */
     cursor[CurNormal] = drw_cur_create(drw, XC_left_ptr);
     cursor[CurResize] = drw_cur_create(drw, XC_sizing);
     cursor[CurMove] = drw_cur_create(drw, XC_fleur);
+    /* init appearance */
+    scheme = ecalloc(LENGTH(colors), sizeof(Clr *));
+    for (i = 0; i < LENGTH(colors); i++) scheme[i] = drw_scm_create(drw, colors[i], 3);
+    /* init bars */
+    updatebars();
     /* supporting window for NetWMCheck */
     wmcheckwin = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
     XChangeProperty(dpy, wmcheckwin, netatom[NetWMCheck], XA_WINDOW, 32, PropModeReplace, (unsigned char *)&wmcheckwin, 1);
@@ -1396,16 +2946,159 @@ void setup() {
     /* EWMH support per view */
     XChangeProperty(dpy, root, netatom[NetSupported], XA_ATOM, 32, PropModeReplace, (unsigned char *)netatom, NetLast);
     XDeleteProperty(dpy, root, netatom[NetClientList]);
+    /* one desktop per tag */
+    ndesktops = LENGTH(tags);
+    XChangeProperty(dpy, root, netatom[NetNumberOfDesktops], XA_CARDINAL, 32, PropModeReplace, (unsigned char *)&ndesktops, 1);
+    for (i = 0, len = 0; i < LENGTH(tags); i++) len += strlen(tags[i]) + 1;
+    names = ecalloc(len, 1);
+    for (i = 0, p = names; i < LENGTH(tags); p += strlen(tags[i]) + 1, i++) strcpy(p, tags[i]);
+    XChangeProperty(dpy, root, netatom[NetDesktopNames], utf8string, 8, PropModeReplace, (unsigned char *)names, len);
+    free(names);
     /* select events */
     wa.cursor = cursor[CurNormal]->cursor;
-    wa.event_mask = SubstructureRedirectMask | SubstructureNotifyMask | ButtonPressMask | PointerMotionMask | EnterWindowMask
-            | LeaveWindowMask | StructureNotifyMask | PropertyChangeMask;
+    wa.event_mask = ROOTMASK;
     XChangeWindowAttributes(dpy, root, CWEventMask | CWCursor, &wa);
     XSelectInput(dpy, root, wa.event_mask);
+    /* held keys send no releases until they're let go, see keypress() */
+    XkbSetDetectableAutoRepeat(dpy, True, NULL);
+#ifdef COMPOSITOR
+    compositing = compositor && comp_init(dpy, screen, root) == 0;
+#endif
+#ifdef OVERVIEW
+    thumbs = thumb_init(dpy, thumbbudget) == 0;
+#endif
     grabkeys();
+    updatestatus();
+    setupstatusfifo();
+    setuptimers();
+    setuplauncher();
+    setupidle();
+    layoutpool = pool_create(MIN(layoutthreads, sysconf(_SC_NPROCESSORS_ONLN) - 1));
+#ifdef WALLPAPER
+    setupwallpaper();
+#endif
+#ifdef PACING
+    setuppacing();
+#endif
     focus(NULL);
+#ifdef XREADER
+    /* read from here on, scan() and the autostart wait on us otherwise */
+    if ((readerfd = reader_start(dpy)) < 0) fputs("dwm: no reader thread, reading events inline\n", stderr);
+#endif
+}
+
+void setupfontcache() {
+    char *path;
+
+    if (!(path = cachepath("fontcache"))) return;
+    drw_fontcache_load(drw, path);
+    free(path);
+}
+
+/* Tells when the user is idle by alarms on the IDLETIME counter of the
+ * SYNC extension. Without it heavy idle tasks don't wait for the user. */
+void setupidle() {
+    XSyncSystemCounter *counters;
+    XSyncCounter idletime = None;
+    XSyncAlarmAttributes attr;
+    int i, n, err, major, minor;
+
+    useridle = 1;
+    if (!XSyncQueryExtension(dpy, &syncevbase, &err) || !XSyncInitialize(dpy, &major, &minor)) {
+        syncevbase = -1;
+        return;
+    }
+    if ((counters = XSyncListSystemCounters(dpy, &n))) {
+        for (i = 0; i < n; i++)
+            if (!strcmp(counters[i].name, "IDLETIME")) idletime = counters[i].counter;
+        XSyncFreeSystemCounterList(counters);
+    }
+    if (idletime == None) return;
+    useridle = 0;
+    attr.trigger.counter = idletime;
+    attr.trigger.value_type = XSyncAbsolute;
+    attr.trigger.test_type = XSyncPositiveComparison;
+    XSyncIntToValue(&attr.trigger.wait_value, idletimeout);
+    XSyncIntToValue(&attr.delta, 0);
+    attr.events = True;
+    idlealarms[0] = XSyncCreateAlarm(dpy, XSyncCACounter | XSyncCAValueType | XSyncCATestType | XSyncCAValue | XSyncCADelta | XSyncCAEvents, &attr);
+    /* fires as soon as it's created, to be rearmed once the user is idle */
+    attr.trigger.test_type = XSyncNegativeComparison;
+    XSyncIntToValue(&attr.trigger.wait_value, idletimeout - 1);
+    idlealarms[1] = XSyncCreateAlarm(dpy, XSyncCACounter | XSyncCAValueType | XSyncCATestType | XSyncCAValue | XSyncCADelta | XSyncCAEvents, &attr);
+}
+
+void setuplauncher() {
+    char *path = cachepath("launches");
+    int fd = launch_init(path);
+
+    if (fd >= 0) watchfd(fd, launch_event);
+    free(path);
+}
+
+#ifdef PACING
+void setuppacing() {
+    int fd;
+
+    if ((pacing = pace_init(xc, root, &fd) == 0) && fd >= 0) watchfd(fd, pace_timer);
+    if (!pacing) fputs("dwm: layouts aren't paced\n", stderr);
+}
+#endif
+
+void setupstatusfifo() {
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    char *parent;
+
+    if (!statusfifo || !dir) return;
+    statuspath = ecalloc(strlen(dir) + strlen(statusfifo) + 2, 1);
+    sprintf(statuspath, "%s/%s", dir, statusfifo);
+    if (parentdir(statuspath, &parent) == 0) {
+        mkdirp(parent);
+        free(parent);
+    }
+    if ((mkfifo(statuspath, 0600) < 0 && errno != EEXIST)
+        /* O_RDWR keeps a writer around, so poll(2) doesn't report EOF between daemons */
+        || (statusfd = open(statuspath, O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0) {
+        fprintf(stderr, "dwm: cannot open status fifo %s: %s\n", statuspath, strerror(errno));
+        free(statuspath);
+        statuspath = NULL;
+        return;
+    }
+    watchfd(statusfd, readstatus);
+}
+
+void setuptimers() {
+    struct itimerspec tick = {{1, 0}, {1, 0}};
+    Timer *t;
+
+    if (!LENGTH(statusmodules)) return;
+    if ((timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0 || timerfd_settime(timerfd, 0, &tick, NULL) < 0) {
+        fprintf(stderr, "dwm: cannot create status timer: %s\n", strerror(errno));
+        return;
+    }
+    watchfd(timerfd, runtimers);
+    /* a first run in config order also fixes the segment order */
+    for (t = modtimer; t < modtimer + LENGTH(modtimer); t++) {
+        modstate[t - modtimer].fd[0] = modstate[t - modtimer].fd[1] = -1;
+        t->interval = MAX(statusmodules[t - modtimer].interval, 1);
+        t->func = runmodule;
+        runmodule(t);
+        addtimer(t);
+    }
 }
 
+#ifdef WALLPAPER
+void setupwallpaper() {
+    char *path = cachepath("wallpaper");
+
+    if (wall_init(dpy, screen, wallpaper, path) == 0)
+        updatewallpaper();
+    else
+        fprintf(stderr, "dwm: no wallpaper matches %s\n", wallpaper);
+    free(path);
+}
+#endif
+
 void seturgent(Client *c, int urg) {
     XWMHints *wmh;
 
@@ -1418,6 +3111,9 @@ void seturgent(Client *c, int urg) {
 
 void showhide(Client *c) {
     if (!c) return;
+#ifdef COMPOSITOR
+    if (compositing) comp_setvisible(c->win, ISVISIBLE(c));
+#endif
     if (ISVISIBLE(c)) {
         /* show clients top down */
         XMoveWindow(dpy, c->win, c->x, c->y);
@@ -1436,6 +3132,18 @@ void sigchld(int unused) {
         ;
 }
 
+/* Sizes the drawing pixmap, which configurenotify() keeps bar high, to h
+ * lines for an overlay and back. The bars are repainted whole after. */
+void sizedrw(unsigned int h) {
+    Monitor *m;
+
+    if (drw->w == (unsigned int)sw && drw->h == h) return;
+    drw_resize(drw, sw, h);
+    for (m = mons; m; m = m->next) m->barinvalid = 1;
+}
+
+void sizehintsreply(void *reply, void *arg) { setsizehints(arg, checkprop(reply)); }
+
 void spawn(const Arg *arg) {
     if (fork() == 0) {
         if (dpy) close(ConnectionNumber(dpy));
@@ -1447,26 +3155,100 @@ void spawn(const Arg *arg) {
     }
 }
 
+/* Holds the autorepeat of k if its function takes sums, adding its
+ * argument to those held. Returns 0 if k is to run right away. */
+int sumrepeat(const Key *k) {
+    size_t i;
+
+    for (i = 0; i < LENGTH(repeatables) && repeatables[i].func != k->func; i++)
+        ;
+    if (i == LENGTH(repeatables)) return 0;
+    if (repeatkey && repeatkey->func != k->func) flushrepeat();
+    if (!repeatkey)
+        repeatarg = k->arg;
+    else if (!repeatables[i].isfloat)
+        repeatarg.i += k->arg.i;
+    else if (k->arg.f < 1.0) /* relative, beyond the range of mfact is as far */
+        repeatarg.f = MAX(-0.9, MIN(repeatarg.f + k->arg.f, 0.9));
+    else
+        repeatarg = k->arg;
+    repeatkey = k;
+    return 1;
+}
+
+/* Lists the clients of all monitors, most recently focused first and the
+ * focused one last, filtered by title and class. */
+void switcher(const Arg *arg) {
+    char input[64] = "";
+    int i = prompt(&switchprompt, input, sizeof input);
+    Arg a;
+    Client *c;
+
+    if (i < 0 || !(c = slots[i])) return;
+    if (c->mon != selmon) {
+        unfocus(selmon->sel, 0);
+        selmon = c->mon;
+    }
+    if (!ISVISIBLE(c)) {
+        a.ui = c->tags;
+        view(&a);
+    }
+    focus(c);
+    restack(selmon);
+}
+
+size_t switchfilter(const char *input, unsigned int *items, size_t max) {
+    unsigned int *ids = ecalloc(nslots, sizeof(unsigned int));
+    size_t n = tri_query(titleindex, input, ids, nslots);
+
+    qsort(ids, n, sizeof(unsigned int), mrucmp);
+    memcpy(items, ids, (n = MIN(n, max)) * sizeof(unsigned int));
+    free(ids);
+    return n;
+}
+
+const char *switchtext(unsigned int item) {
+    static char text[sizeof slots[0]->name + sizeof slots[0]->class + 8];
+
+    snprintf(text, sizeof text, "%s  (%s)", slots[item]->name, slots[item]->class);
+    return text;
+}
+
 void tag(const Arg *arg) {
     if (selmon->sel && arg->ui & TAGMASK) {
         selmon->sel->tags = arg->ui & TAGMASK;
+        updatedesktop(selmon->sel);
         focus(NULL);
         arrange(selmon);
     }
 }
 
+/* The desktop of a tag set is its first tag, all tags are every desktop. */
+long tagdesktop(unsigned int tagset) {
+    if ((tagset & TAGMASK) == TAGMASK) return -1; /* 0xFFFFFFFF in the property */
+    return tagset ? __builtin_ctz(tagset) : 0;
+}
+
 void tagmon(const Arg *arg) {
     if (!selmon->sel || !mons->next) return;
     sendmon(selmon->sel, dirtomon(arg->i));
 }
 
+/* Only computes the geometry into m->placed, so it may run on any thread,
+ * see applylayout(). */
 void tile(Monitor *m) {
     unsigned int i, n, h, mw, my, ty;
     Client *c;
 
+    m->nplaced = 0;
     for (n = 0, c = nexttiled(m->clients); c; c = nexttiled(c->next), n++)
         ;
     if (n == 0) return;
+    if (n > m->placedsize) {
+        free(m->placed);
+        m->placed = ecalloc(n, sizeof(Placement));
+        m->placedsize = n;
+    }
 
     if (n > m->nmaster)
         mw = m->nmaster ? m->ww * m->mfact : 0;
@@ -1475,15 +3257,28 @@ void tile(Monitor *m) {
     for (i = 0, my = ty = m->gappx, c = nexttiled(m->clients); c; c = nexttiled(c->next), i++)
         if (i < m->nmaster) {
             h = (m->wh - my) / (MIN(n, m->nmaster) - i) - m->gappx;
-            resize(c, m->wx + m->gappx, m->wy + my, mw - (2 * c->bw) - m->gappx, h - (2 * c->bw), 0);
-            if (my + HEIGHT(c) < m->wh) my += HEIGHT(c) + m->gappx;
+            h = place(m, c, m->wx + m->gappx, m->wy + my, mw - (2 * c->bw) - m->gappx, h - (2 * c->bw));
+            if (my + h < m->wh) my += h + m->gappx;
         } else {
             h = (m->wh - ty) / (n - i) - m->gappx;
-            resize(c, m->wx + mw + m->gappx, m->wy + ty, m->ww - mw - (2 * c->bw) - 2 * m->gappx, h - (2 * c->bw), 0);
-            if (ty + HEIGHT(c) < m->wh) ty += HEIGHT(c) + m->gappx;
+            h = place(m, c, m->wx + mw + m->gappx, m->wy + ty, m->ww - mw - (2 * c->bw) - 2 * m->gappx, h - (2 * c->bw));
+            if (ty + h < m->wh) ty += h + m->gappx;
         }
 }
 
+void tilemon(size_t i, void *mons) { tile(((Monitor **)mons)[i]); }
+
+/* Ends a title change with the WM_NAME reply, NULL keeps the title
+ * nettitlereply() found. */
+void titlereply(void *reply, void *arg) {
+    Client *c = arg;
+
+    if (reply) replytext(checkprop(reply), c->name, sizeof c->name);
+    if (c->name[0] == '\0') strcpy(c->name, broken);
+    indexclient(c);
+    if (c == c->mon->sel) drawbar(c->mon);
+}
+
 void togglefloating(const Arg *arg) {
     if (!selmon->sel) return;
     if (selmon->sel->isfullscreen) /* no support for fullscreen windows */
@@ -1491,6 +3286,7 @@ void togglefloating(const Arg *arg) {
     selmon->sel->isfloating = !selmon->sel->isfloating || selmon->sel->isfixed;
     if (selmon->sel->isfloating) resize(selmon->sel, selmon->sel->x, selmon->sel->y, selmon->sel->w, selmon->sel->h, 0);
     arrange(selmon);
+    drawbar(selmon);
 }
 
 void togglefullscr(const Arg *arg) {
@@ -1504,6 +3300,7 @@ void toggletag(const Arg *arg) {
     newtags = selmon->sel->tags ^ (arg->ui & TAGMASK);
     if (newtags) {
         selmon->sel->tags = newtags;
+        updatedesktop(selmon->sel);
         focus(NULL);
         arrange(selmon);
     }
@@ -1534,20 +3331,29 @@ void unmanage(Client *c, int destroyed) {
 
     detach(c);
     detachstack(c);
+    if (c == gameclient) setgamemode(NULL);
+    async_cancel(c->win);
+    tri_set(titleindex, c->slot, NULL);
+    slots[c->slot] = NULL;
+#ifdef OVERVIEW
+    if (thumbs) thumb_forget(c->win, destroyed);
+#endif
     if (!destroyed) {
         wc.border_width = c->oldbw;
         XGrabServer(dpy); /* avoid race conditions */
         XSetErrorHandler(xerrordummy);
         XConfigureWindow(dpy, c->win, CWBorderWidth, &wc); /* restore border */
+        if (c->isfullscreen) setbypass(c, 0);
         XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
         setclientstate(c, WithdrawnState);
+        XDeleteProperty(dpy, c->win, netatom[NetWMDesktop]);
         XSync(dpy, False);
         XSetErrorHandler(xerror);
         XUngrabServer(dpy);
     }
     free(c);
     focus(NULL);
-    updateclientlist();
+    postidle(IdleClientList);
     arrange(m);
 }
 
@@ -1557,9 +3363,11 @@ void unmanagealtbar(Window w) {
     if (!m) return;
 
     m->barwin = 0;
+    m->isaltbar = 0;
     m->by = 0;
-    m->bh = 0;
+    m->bh = showbar ? drw->fonts->h + 2 : 0;
     updatebarpos(m);
+    updatebars();
     arrange(m);
 }
 
@@ -1597,16 +3405,64 @@ void updatebarpos(Monitor *m) {
     m->wy = m->wy + m->bh;
 }
 
+void updatebars() {
+    Monitor *m;
+    XSetWindowAttributes wa = {.background_pixmap = ParentRelative, .event_mask = ButtonPressMask | ExposureMask, .override_redirect = True};
+
+    if (!showbar) return;
+    for (m = mons; m; m = m->next) {
+        if (m->barwin) continue;
+        m->barwin = XCreateWindow(dpy, root, m->wx, m->by, m->ww, m->bh, 0, DefaultDepth(dpy, screen), CopyFromParent,
+                                  DefaultVisual(dpy, screen), CWOverrideRedirect | CWBackPixmap | CWEventMask, &wa);
+        XDefineCursor(dpy, m->barwin, cursor[CurNormal]->cursor);
+        XMapRaised(dpy, m->barwin);
+        m->barinvalid = 1;
+    }
+}
+
 void updateclientlist() {
     Client *c;
     Monitor *m;
 
+    if (gameclient) {
+        deferred |= DeferClientList;
+        return;
+    }
     XDeleteProperty(dpy, root, netatom[NetClientList]);
     for (m = mons; m; m = m->next)
         for (c = m->clients; c; c = c->next)
             XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend, (unsigned char *)&(c->win), 1);
 }
 
+/* Both desktop properties are only written when they change, so pagers
+ * can follow PropertyNotify. The current desktop has to be a real one, all
+ * tags show as the first. */
+void updatecurrentdesktop() {
+    static long current = -2;
+    long d = tagdesktop(selmon->tagset[selmon->seltags]);
+
+    if (gameclient) {
+        deferred |= DeferDesktops;
+        return;
+    }
+    if (d < 0) d = 0;
+    if (d == current) return;
+    current = d;
+    XChangeProperty(dpy, root, netatom[NetCurrentDesktop], XA_CARDINAL, 32, PropModeReplace, (unsigned char *)&d, 1);
+}
+
+void updatedesktop(Client *c) {
+    long d = tagdesktop(c->tags);
+
+    if (gameclient) {
+        deferred |= DeferDesktops;
+        return;
+    }
+    if (d == c->desktop) return;
+    c->desktop = d;
+    XChangeProperty(dpy, c->win, netatom[NetWMDesktop], XA_CARDINAL, 32, PropModeReplace, (unsigned char *)&d, 1);
+}
+
 int updategeom() {
     int dirty = 0;
 
@@ -1690,75 +3546,79 @@ void updatenumlockmask() {
     XFreeModifiermap(modmap);
 }
 
-void updatesizehints(Client *c) {
-    long msize;
-    XSizeHints size;
+void updatesizehints(Client *c) { setsizehints(c, getpropreply(getprop(c->win, XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS, 18))); }
 
-    if (!XGetWMNormalHints(dpy, c->win, &size, &msize)) /* size is uninitialized, ensure that size.flags aren't used */
-        size.flags = PSize;
-    if (size.flags & PBaseSize) {
-        c->basew = size.base_width;
-        c->baseh = size.base_height;
-    } else if (size.flags & PMinSize) {
-        c->basew = size.min_width;
-        c->baseh = size.min_height;
-    } else
-        c->basew = c->baseh = 0;
-    if (size.flags & PResizeInc) {
-        c->incw = size.width_inc;
-        c->inch = size.height_inc;
-    } else
-        c->incw = c->inch = 0;
-    if (size.flags & PMaxSize) {
-        c->maxw = size.max_width;
-        c->maxh = size.max_height;
-    } else
-        c->maxw = c->maxh = 0;
-    if (size.flags & PMinSize) {
-        c->minw = size.min_width;
-        c->minh = size.min_height;
-    } else if (size.flags & PBaseSize) {
-        c->minw = size.base_width;
-        c->minh = size.base_height;
-    } else
-        c->minw = c->minh = 0;
-    if (size.flags & PAspect) {
-        c->mina = (float)size.min_aspect.y / size.min_aspect.x;
-        c->maxa = (float)size.max_aspect.x / size.max_aspect.y;
-    } else
-        c->maxa = c->mina = 0.0;
-    c->isfixed = (c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh);
+void updatestatus() {
+    char text[sizeof stext];
+
+    /* the root window name is the fallback for xsetroot(1) style feeders */
+    if (!gettextprop(root, XA_WM_NAME, text, sizeof text)) {
+        if (!stext[0]) strcpy(stext, "dwm-" VERSION);
+    } else if (strcmp(text, stext)) {
+        rawstatus = 1;
+        nsegments = 0;
+        strcpy(stext, text);
+    }
+    drawbar(selmon);
 }
 
 void updatetitle(Client *c) {
     if (!gettextprop(c->win, netatom[NetWMName], c->name, sizeof c->name)) gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
     if (c->name[0] == '\0') /* hack to mark broken clients */
         strcpy(c->name, broken);
+    indexclient(c);
 }
 
+#ifdef WALLPAPER
+void updatewallpaper() {
+    XRectangle r[16];
+    Monitor *m;
+    int n = 0;
+
+    for (m = mons; m && n < LENGTH(r); m = m->next, n++) {
+        r[n].x = m->mx;
+        r[n].y = m->my;
+        r[n].width = m->mw;
+        r[n].height = m->mh;
+    }
+    wall_paint(r, n, sw, sh);
+}
+#endif
+
 void updatewindowtype(Client *c) {
-    Atom state = getatomprop(c, netatom[NetWMState]);
-    Atom wtype = getatomprop(c, netatom[NetWMWindowType]);
+    /* both requests go out before waiting for either */
+    xcb_get_property_cookie_t sc = getprop(c->win, netatom[NetWMState], XA_ATOM, 1);
+    xcb_get_property_cookie_t tc = getprop(c->win, netatom[NetWMWindowType], XA_ATOM, 1);
+    Atom state = getatomreply(sc);
+    Atom wtype = getatomreply(tc);
 
     if (state == netatom[NetWMFullscreen]) setfullscreen(c, 1);
     if (wtype == netatom[NetWMWindowTypeDialog]) c->isfloating = 1;
 }
 
 void updatewmhints(Client *c) {
-    XWMHints *wmh;
+    xcb_get_property_reply_t *r = getpropreply(getprop(c->win, XA_WM_HINTS, XA_WM_HINTS, 9));
+    uint32_t *v; /* flags input initial_state icon_pixmap icon_window icon_x icon_y icon_mask window_group */
 
-    if ((wmh = XGetWMHints(dpy, c->win))) {
-        if (c == selmon->sel && wmh->flags & XUrgencyHint) {
-            wmh->flags &= ~XUrgencyHint;
-            XSetWMHints(dpy, c->win, wmh);
-        } else
-            c->isurgent = (wmh->flags & XUrgencyHint) ? 1 : 0;
-        if (wmh->flags & InputHint)
-            c->neverfocus = !wmh->input;
-        else
-            c->neverfocus = 0;
-        XFree(wmh);
+    int n;
+
+    if (!r) return;
+    v = xcb_get_property_value(r);
+    /* like XGetWMHints(3), only the window group may be missing */
+    if ((n = xcb_get_property_value_length(r) / 4) < 8) {
+        free(r);
+        return;
     }
+    if (c == selmon->sel && v[0] & XUrgencyHint) {
+        v[0] &= ~XUrgencyHint;
+        xcb_change_property(xc, XCB_PROP_MODE_REPLACE, c->win, XA_WM_HINTS, XA_WM_HINTS, 32, n, v);
+    } else
+        c->isurgent = (v[0] & XUrgencyHint) ? 1 : 0;
+    if (v[0] & InputHint)
+        c->neverfocus = !v[1];
+    else
+        c->neverfocus = 0;
+    free(r);
 }
 
 void view(const Arg *arg) {
@@ -1769,6 +3629,12 @@ void view(const Arg *arg) {
     arrange(selmon);
 }
 
+void watchfd(int fd, void (*func)(int fd)) {
+    if (nwatches == LENGTH(watches)) die("dwm: too many watched file descriptors");
+    watches[nwatches].fd = fd;
+    watches[nwatches++].func = func;
+}
+
 Client *wintoclient(Window w) {
     Client *c;
     Monitor *m;
@@ -1811,6 +3677,12 @@ int wmclasscontains(Window win, const char *class, const char *name) {
  * ignored (especially on UnmapNotify's). Other types of errors call Xlibs
  * default error handler, which may call exit. */
 int xerror(Display *dpy, XErrorEvent *ee) {
+#ifdef COMPOSITOR
+    if (compositing && comp_ignoreerror(ee)) return 0;
+#endif
+#ifdef OVERVIEW
+    if (thumbs && thumb_ignoreerror(ee)) return 0;
+#endif
     if (ee->error_code == BadWindow || (ee->request_code == X_SetInputFocus && ee->error_code == BadMatch)
         || (ee->request_code == X_PolyText8 && ee->error_code == BadDrawable)
         || (ee->request_code == X_PolyFillRectangle && ee->error_code == BadDrawable)
@@ -1818,7 +3690,8 @@ int xerror(Display *dpy, XErrorEvent *ee) {
         || (ee->request_code == X_ConfigureWindow && ee->error_code == BadMatch)
         || (ee->request_code == X_GrabButton && ee->error_code == BadAccess)
         || (ee->request_code == X_GrabKey && ee->error_code == BadAccess)
-        || (ee->request_code == X_CopyArea && ee->error_code == BadDrawable))
+        || (ee->request_code == X_CopyArea && ee->error_code == BadDrawable)
+        || (ee->request_code == X_KillClient && ee->error_code == BadValue))
         return 0;
     fprintf(stderr, "dwm: fatal error: request code=%d, error code=%d\n", ee->request_code, ee->error_code);
     return xerrorxlib(dpy, ee); /* may call exit */
@@ -1848,6 +3721,8 @@ int main(int argc, char *argv[]) {
     else if (argc != 1)
         die("usage: dwm [-v]");
     if (!setlocale(LC_CTYPE, "") || !XSupportsLocale()) fputs("warning: no locale support\n", stderr);
+    /* for the reader and the fetch worker */
+    if (!XInitThreads()) die("dwm: no thread support in Xlib");
     if (!(dpy = XOpenDisplay(NULL))) die("dwm: cannot open display");
     checkotherwm();
     setup();
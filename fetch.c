@@ -0,0 +1,187 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * A worker thread with an X connection of its own, reading and decoding
+ * the text properties of windows. A long title of a slow client then costs
+ * the worker the round trip and the conversion, while dwm goes on with input.
+ * Jobs are done in the order they're posted; results are taken by the main
+ * thread once the descriptor returned by fetch_init() is readable, and
+ * carry only the window, so whatever it belonged to must be looked up again. */
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "fetch.h"
+#include "util.h"
+
+typedef struct Fetch Fetch;
+struct Fetch {
+    FetchResult r;
+    Fetch *next;
+};
+
+static Display *dpy; /* the worker's own */
+static Atom netwmname;
+static pthread_t thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t posted = PTHREAD_COND_INITIALIZER;
+static Fetch *jobs, *done, *spare; /* jobs and done are kept in order, newest first */
+static int donefd = -1, quit;
+
+static int textprop(Window w, Atom atom, char *text, unsigned int size) {
+    char **list = NULL;
+    int n;
+    XTextProperty name;
+
+    text[0] = '\0';
+    if (!XGetTextProperty(dpy, w, &name, atom) || !name.nitems) return 0;
+    if (name.encoding == XA_STRING)
+        strncpy(text, (char *)name.value, size - 1);
+    else if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
+        strncpy(text, *list, size - 1);
+        XFreeStringList(list);
+    }
+    text[size - 1] = '\0';
+    XFree(name.value);
+    return 1;
+}
+
+static void run(Fetch *f) {
+    XClassHint ch = {NULL, NULL};
+
+    if (f->r.what & FetchTitle && !textprop(f->r.win, netwmname, f->r.name, sizeof f->r.name))
+        textprop(f->r.win, XA_WM_NAME, f->r.name, sizeof f->r.name);
+    if (f->r.what & FetchClass) {
+        f->r.class[0] = '\0';
+        if (XGetClassHint(dpy, f->r.win, &ch) && ch.res_class) strncpy(f->r.class, ch.res_class, sizeof f->r.class - 1);
+        f->r.class[sizeof f->r.class - 1] = '\0';
+        if (ch.res_class) XFree(ch.res_class);
+        if (ch.res_name) XFree(ch.res_name);
+    }
+}
+
+/* Takes the oldest job off the list p. */
+static Fetch *oldest(Fetch **p) {
+    Fetch *f;
+
+    while ((*p)->next) p = &(*p)->next;
+    f = *p;
+    *p = NULL;
+    return f;
+}
+
+static void *worker(void *arg) {
+    Fetch *f;
+    uint64_t one = 1;
+
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        while (!jobs && !quit) pthread_cond_wait(&posted, &lock);
+        if (quit) {
+            pthread_mutex_unlock(&lock);
+            return NULL;
+        }
+        f = oldest(&jobs);
+        pthread_mutex_unlock(&lock);
+        run(f);
+        pthread_mutex_lock(&lock);
+        f->next = done;
+        done = f;
+        pthread_mutex_unlock(&lock);
+        (void)!write(donefd, &one, sizeof one);
+    }
+}
+
+/* Connects to display and starts the worker. Returns the descriptor that
+ * becomes readable with results to take, or -1. XInitThreads() must have
+ * been called. */
+int fetch_init(const char *display) {
+    sigset_t all, old;
+    int err;
+
+    if (!(dpy = XOpenDisplay(display))) return -1;
+    netwmname = XInternAtom(dpy, "_NET_WM_NAME", False);
+    if ((donefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        XCloseDisplay(dpy);
+        return -1;
+    }
+    fcntl(ConnectionNumber(dpy), F_SETFD, FD_CLOEXEC);
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    err = pthread_create(&thread, NULL, worker, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        close(donefd);
+        donefd = -1;
+        XCloseDisplay(dpy);
+        return -1;
+    }
+    return donefd;
+}
+
+void fetch_cleanup() {
+    Fetch *f, **lists[] = {&jobs, &done, &spare};
+    size_t i;
+
+    if (donefd < 0) return;
+    pthread_mutex_lock(&lock);
+    quit = 1;
+    pthread_cond_signal(&posted);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    for (i = 0; i < sizeof lists / sizeof *lists; i++)
+        while ((f = *lists[i])) {
+            *lists[i] = f->next;
+            free(f);
+        }
+    close(donefd);
+    donefd = -1;
+    XCloseDisplay(dpy);
+}
+
+/* Asks for what of win, a job still waiting for win takes it on instead. */
+void fetch_post(Window win, unsigned int what) {
+    Fetch *f;
+
+    pthread_mutex_lock(&lock);
+    for (f = jobs; f && f->r.win != win; f = f->next)
+        ;
+    if (f)
+        f->r.what |= what;
+    else {
+        if ((f = spare))
+            spare = f->next;
+        else
+            f = ecalloc(1, sizeof(Fetch));
+        f->r.win = win;
+        f->r.what = what;
+        f->next = jobs;
+        jobs = f;
+        pthread_cond_signal(&posted);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* Takes the oldest result into r. Returns 0 if there's none. */
+int fetch_take(FetchResult *r) {
+    Fetch *f = NULL;
+    uint64_t n;
+
+    pthread_mutex_lock(&lock);
+    if (done) {
+        f = oldest(&done);
+        *r = f->r;
+        f->next = spare;
+        spare = f;
+    } else /* all taken, clears the wakeup */
+        (void)!read(donefd, &n, sizeof n);
+    pthread_mutex_unlock(&lock);
+    return f != NULL;
+}
@@ -0,0 +1,16 @@
+/* See LICENSE file for copyright and license details. */
+
+enum { FetchTitle = 1, FetchClass = 2 }; /* what to fetch */
+
+typedef struct {
+    Window win;
+    unsigned int what;
+    char name[256]; /* _NET_WM_NAME or WM_NAME */
+    char class[64];
+} FetchResult;
+
+/* Text properties read by a worker with its own connection, see fetch.c */
+int fetch_init(const char *display);
+void fetch_cleanup();
+void fetch_post(Window win, unsigned int what);
+int fetch_take(FetchResult *r);
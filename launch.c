@@ -0,0 +1,294 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * The launcher's index of the executables in $PATH. It is built once at
+ * startup and kept current through inotify(7) on the PATH directories, so
+ * opening the launcher never scans them. Names are matched through a
+ * trigram index and ranked by how often they were launched; the counts
+ * persist in a small text file. */
+#define _GNU_SOURCE /* POSIX_SPAWN_SETSID */
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "launch.h"
+#include "trigram.h"
+#include "util.h"
+
+#define WATCHMASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB)
+
+typedef struct {
+    char *name;
+    int dir;            /* first PATH directory that has it, -1 if none */
+    unsigned int count; /* launches */
+} Exe;
+
+extern char **environ;
+
+static char **dirs;
+static int ndirs;
+static Exe *exes;
+static unsigned int nexes;
+static unsigned int *table; /* exes by name hash, id + 1, 0 is empty */
+static size_t tablesize;
+static TriIndex *names;
+static char *countpath;
+static int countsdirty; /* launched since savecounts() */
+static int inotifyfd = -1;
+static const char *rankinput; /* for rankcmp() */
+
+static size_t hash(const char *s) {
+    size_t h = 2166136261u;
+
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static int find(const char *name) {
+    size_t i;
+
+    if (!tablesize) return -1;
+    for (i = hash(name) & (tablesize - 1); table[i]; i = (i + 1) & (tablesize - 1))
+        if (!strcmp(exes[table[i] - 1].name, name)) return table[i] - 1;
+    return -1;
+}
+
+static void insert(unsigned int id) {
+    size_t i;
+
+    for (i = hash(exes[id].name) & (tablesize - 1); table[i]; i = (i + 1) & (tablesize - 1))
+        ;
+    table[i] = id + 1;
+}
+
+static unsigned int add(const char *name) {
+    unsigned int i;
+
+    if ((nexes + 1) * 2 > tablesize) {
+        free(table);
+        tablesize = tablesize ? tablesize * 2 : 1024;
+        table = ecalloc(tablesize, sizeof(unsigned int));
+        for (i = 0; i < nexes; i++) insert(i);
+    }
+    if (!(nexes % 256) && !(exes = realloc(exes, (nexes + 256) * sizeof(Exe)))) die("realloc:");
+    exes[nexes].name = ecalloc(strlen(name) + 1, 1);
+    strcpy(exes[nexes].name, name);
+    exes[nexes].dir = -1;
+    exes[nexes].count = 0;
+    insert(nexes);
+    return nexes++;
+}
+
+static int isexec(const char *dir, const char *name) {
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (snprintf(path, sizeof path, "%s/%s", dir, name) >= (int)sizeof path) return 0;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+/* Names without a directory stay known for their count, but aren't listed. */
+static void setdir(unsigned int id, int dir) {
+    if (dir >= 0 && exes[id].dir < 0)
+        tri_set(names, id, exes[id].name);
+    else if (dir < 0 && exes[id].dir >= 0)
+        tri_set(names, id, NULL);
+    exes[id].dir = dir;
+}
+
+static void scan() {
+    DIR *dp;
+    struct dirent *de;
+    int d, id;
+
+    for (d = 0; d < ndirs; d++) {
+        if (!(dp = opendir(dirs[d]))) continue;
+        while ((de = readdir(dp))) {
+            if (de->d_name[0] == '.' || de->d_type == DT_DIR) continue;
+            /* an earlier directory shadows this one */
+            if ((id = find(de->d_name)) >= 0 && exes[id].dir >= 0) continue;
+            if (isexec(dirs[d], de->d_name)) setdir(id >= 0 ? (unsigned int)id : add(de->d_name), d);
+        }
+        closedir(dp);
+    }
+}
+
+static void refresh(const char *name) {
+    int d, id = find(name);
+
+    for (d = 0; d < ndirs && !isexec(dirs[d], name); d++)
+        ;
+    if (d < ndirs)
+        setdir(id >= 0 ? (unsigned int)id : add(name), d);
+    else if (id >= 0)
+        setdir(id, -1);
+}
+
+static void loadcounts() {
+    FILE *f;
+    char name[256];
+    unsigned int count;
+    int id;
+
+    if (!countpath || !(f = fopen(countpath, "r"))) return;
+    while (fscanf(f, "%u %255[^\n]", &count, name) == 2) {
+        if ((id = find(name)) < 0) id = add(name);
+        exes[id].count = count;
+    }
+    fclose(f);
+}
+
+static void savecounts() {
+    FILE *f;
+    char *tmp;
+    unsigned int i;
+
+    if (!countpath || !countsdirty) return;
+    countsdirty = 0;
+    tmp = ecalloc(strlen(countpath) + 5, 1);
+    sprintf(tmp, "%s.tmp", countpath);
+    if ((f = fopen(tmp, "w"))) {
+        for (i = 0; i < nexes; i++)
+            if (exes[i].count) fprintf(f, "%u %s\n", exes[i].count, exes[i].name);
+        if (fclose(f) == 0) rename(tmp, countpath);
+    }
+    free(tmp);
+}
+
+/* posix_spawn(3) doesn't copy dwm's address space like fork(2) would. */
+static void spawnv(char *const argv[]) {
+    posix_spawnattr_t attr;
+    pid_t pid;
+    int err;
+
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+    if ((err = posix_spawn(&pid, argv[0], NULL, &attr, argv, environ)))
+        fprintf(stderr, "dwm: cannot launch %s: %s\n", argv[0], strerror(err));
+    posix_spawnattr_destroy(&attr);
+}
+
+/* Most launched first, then names starting with the input, then shorter. */
+static int rankcmp(const void *a, const void *b) {
+    const Exe *ea = &exes[*(const unsigned int *)a], *eb = &exes[*(const unsigned int *)b];
+    size_t n = strlen(rankinput), la, lb;
+    int pa, pb;
+
+    if (ea->count != eb->count) return ea->count < eb->count ? 1 : -1;
+    pa = !strncasecmp(ea->name, rankinput, n);
+    pb = !strncasecmp(eb->name, rankinput, n);
+    if (pa != pb) return pb - pa;
+    if ((la = strlen(ea->name)) != (lb = strlen(eb->name))) return la < lb ? -1 : 1;
+    return strcmp(ea->name, eb->name);
+}
+
+/* Builds the index and returns the inotify descriptor to poll, or -1 if
+ * the index can't follow changes. */
+int launch_init(const char *countfile) {
+    const char *path = getenv("PATH");
+    char *buf, *s;
+    int d;
+
+    names = tri_create();
+    if (countfile) {
+        countpath = ecalloc(strlen(countfile) + 1, 1);
+        strcpy(countpath, countfile);
+    }
+    if (path) {
+        buf = ecalloc(strlen(path) + 1, 1);
+        strcpy(buf, path);
+        for (s = strtok(buf, ":"); s; s = strtok(NULL, ":")) {
+            if (!(dirs = realloc(dirs, (ndirs + 1) * sizeof(char *)))) die("realloc:");
+            dirs[ndirs] = ecalloc(strlen(s) + 1, 1);
+            strcpy(dirs[ndirs++], s);
+        }
+        free(buf);
+    }
+    /* watch before scanning, so nothing falls in between */
+    if ((inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) >= 0)
+        for (d = 0; d < ndirs; d++) inotify_add_watch(inotifyfd, dirs[d], WATCHMASK);
+    scan();
+    loadcounts();
+    return inotifyfd;
+}
+
+void launch_cleanup() {
+    unsigned int i;
+    int d;
+
+    savecounts();
+    if (inotifyfd >= 0) close(inotifyfd);
+    for (i = 0; i < nexes; i++) free(exes[i].name);
+    for (d = 0; d < ndirs; d++) free(dirs[d]);
+    free(exes);
+    free(dirs);
+    free(table);
+    free(countpath);
+    tri_free(names);
+}
+
+void launch_event(int fd) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ev;
+    ssize_t len;
+    char *p;
+    unsigned int i;
+
+    while ((len = read(fd, buf, sizeof buf)) > 0)
+        for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+            ev = (struct inotify_event *)p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                for (i = 0; i < nexes; i++) setdir(i, -1);
+                scan();
+            } else if (ev->len && ev->name[0] != '.')
+                refresh(ev->name);
+        }
+}
+
+const char *launch_name(unsigned int id) { return exes[id].name; }
+
+size_t launch_query(const char *input, unsigned int *ids, size_t max) {
+    unsigned int *all = ecalloc(nexes ? nexes : 1, sizeof(unsigned int));
+    size_t n = tri_query(names, input, all, nexes);
+
+    rankinput = input;
+    qsort(all, n, sizeof(unsigned int), rankcmp);
+    memcpy(ids, all, (n = MIN(n, max)) * sizeof(unsigned int));
+    free(all);
+    return n;
+}
+
+void launch_run(unsigned int id) {
+    char path[PATH_MAX];
+    char *argv[] = {path, NULL};
+
+    if (id >= nexes || exes[id].dir < 0) return;
+    snprintf(path, sizeof path, "%s/%s", dirs[exes[id].dir], exes[id].name);
+    spawnv(argv);
+    exes[id].count++;
+    countsdirty = 1;
+}
+
+/* Writes the launch counts if they changed, launches leave that to the
+ * caller. */
+void launch_save() { savecounts(); }
+
+/* Runs cmd through sh(1), counting it for its first word. */
+void launch_shell(const char *cmd) {
+    char *argv[] = {"/bin/sh", "-c", (char *)cmd, NULL};
+    char word[256];
+    int id;
+
+    spawnv(argv);
+    if (sscanf(cmd, "%255s", word) == 1 && (id = find(word)) >= 0) {
+        exes[id].count++;
+        countsdirty = 1;
+    }
+}
@@ -0,0 +1,11 @@
+/* See LICENSE file for copyright and license details. */
+
+/* Index of the executables in $PATH for the launcher */
+int launch_init(const char *countfile);
+void launch_cleanup();
+void launch_event(int fd);
+const char *launch_name(unsigned int id);
+size_t launch_query(const char *input, unsigned int *ids, size_t max);
+void launch_run(unsigned int id);
+void launch_save();
+void launch_shell(const char *cmd);
@@ -0,0 +1,184 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Pacing of layout commits to the refresh of the monitors. A commit for
+ * a monitor is requested with pace_request() and becomes due at the next
+ * vblank of the CRTC showing it, as reported by a Present MSC notification
+ * on a small unmapped window at the monitor's origin. The notifications go
+ * to XCB special event queues, Xlib never sees them. Without Present a
+ * timer ticking at the highest refresh rate RandR reports stands in for all
+ * monitors. */
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+#include <xcb/xcb.h>
+#include <xcb/present.h>
+#include <xcb/randr.h>
+
+#include "pace.h"
+#include "util.h"
+
+#define NPACERS 16
+
+typedef struct {
+    xcb_window_t win; /* InputOnly, never mapped */
+    int x, y;
+    xcb_special_event_t *events;
+    int requested, due;
+} Pacer;
+
+static xcb_connection_t *xc;
+static xcb_window_t root;
+static Pacer pacers[NPACERS]; /* by monitor */
+static int present;      /* else the timer paces */
+static int timerfd = -1;
+static long long period; /* ns per frame of the timer */
+static uint32_t serial;
+
+/* Returns the highest refresh rate in mHz of the active CRTCs, 60 Hz if
+ * RandR can't tell. */
+static long long refreshrate() {
+    xcb_randr_get_screen_resources_current_reply_t *res;
+    xcb_randr_get_crtc_info_cookie_t ck[NPACERS];
+    xcb_randr_get_crtc_info_reply_t *crtc;
+    xcb_randr_mode_info_t *modes;
+    xcb_randr_crtc_t *crtcs;
+    long long rate, best = 0;
+    int i, j, n, nmodes;
+
+    if (!xcb_get_extension_data(xc, &xcb_randr_id)->present
+        || !(res = xcb_randr_get_screen_resources_current_reply(xc, xcb_randr_get_screen_resources_current(xc, root), NULL)))
+        return 60000;
+    crtcs = xcb_randr_get_screen_resources_current_crtcs(res);
+    modes = xcb_randr_get_screen_resources_current_modes(res);
+    nmodes = xcb_randr_get_screen_resources_current_modes_length(res);
+    n = MIN(xcb_randr_get_screen_resources_current_crtcs_length(res), NPACERS);
+    for (i = 0; i < n; i++) ck[i] = xcb_randr_get_crtc_info(xc, crtcs[i], res->config_timestamp);
+    for (i = 0; i < n; i++) {
+        if (!(crtc = xcb_randr_get_crtc_info_reply(xc, ck[i], NULL))) continue;
+        for (j = 0; crtc->mode && j < nmodes; j++)
+            if (modes[j].id == crtc->mode && modes[j].htotal && modes[j].vtotal) {
+                rate = modes[j].dot_clock * 1000LL / ((long long)modes[j].htotal * modes[j].vtotal);
+                best = MAX(best, rate);
+            }
+        free(crtc);
+    }
+    free(res);
+    return best ? best : 60000;
+}
+
+/* Returns 0 if commits can be paced, fd is set to the timer to watch when
+ * there's no Present, -1 otherwise. */
+int pace_init(xcb_connection_t *c, Window r, int *fd) {
+    xcb_present_query_version_reply_t *v;
+
+    xc = c;
+    root = r;
+    *fd = -1;
+    if (xcb_get_extension_data(xc, &xcb_present_id)->present
+        && (v = xcb_present_query_version_reply(xc, xcb_present_query_version(xc, 1, 0), NULL))) {
+        present = 1;
+        free(v);
+        return 0;
+    }
+    period = 1000000000000LL / refreshrate();
+    if ((timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) return -1;
+    *fd = timerfd;
+    return 0;
+}
+
+void pace_cleanup() {
+    int i;
+
+    for (i = 0; i < NPACERS; i++) {
+        if (pacers[i].events) xcb_unregister_for_special_event(xc, pacers[i].events);
+        if (pacers[i].win) xcb_destroy_window(xc, pacers[i].win);
+    }
+    if (timerfd >= 0) close(timerfd);
+    timerfd = -1;
+}
+
+/* Asks for monitor id, whose origin is x, y, to become due at its next
+ * vblank. Returns -1 if it can't be paced. */
+int pace_request(int id, int x, int y) {
+    Pacer *p;
+    uint32_t eid, pos[2] = {x, y};
+    struct itimerspec next = {{0, 0}, {0, 0}};
+    struct timespec now;
+    long long t;
+
+    if (id < 0 || id >= NPACERS) return -1;
+    p = &pacers[id];
+    if (p->requested) return 0;
+    p->requested = 1;
+    if (!present) {
+        /* one tick serves every monitor, it's armed already if any waits */
+        for (id = 0; id < NPACERS && (pacers + id == p || !pacers[id].requested || pacers[id].due); id++)
+            ;
+        if (id < NPACERS) return 0;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        t = (now.tv_sec * 1000000000LL + now.tv_nsec) / period * period + period;
+        next.it_value.tv_sec = t / 1000000000LL;
+        next.it_value.tv_nsec = t % 1000000000LL;
+        return timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &next, NULL);
+    }
+    if (!p->win) {
+        p->win = xcb_generate_id(xc);
+        xcb_create_window(xc, 0, p->win, root, x, y, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, 0, NULL);
+        eid = xcb_generate_id(xc);
+        xcb_present_select_input(xc, eid, p->win, XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY);
+        p->events = xcb_register_for_special_xge(xc, &xcb_present_id, eid, NULL);
+        p->x = x;
+        p->y = y;
+    } else if (p->x != x || p->y != y) {
+        /* the monitor moved, the CRTC under its origin is the one to follow */
+        xcb_configure_window(xc, p->win, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, pos);
+        p->x = x;
+        p->y = y;
+    }
+    /* the next MSC, since a divisor of 1 matches any */
+    xcb_present_notify_msc(xc, p->win, ++serial, 0, 1, 0);
+    return 0;
+}
+
+/* Returns whether a monitor is due, taking what arrived from the server. */
+int pace_ready() {
+    xcb_generic_event_t *ev;
+    int i, ready = 0;
+
+    for (i = 0; i < NPACERS; i++) {
+        while (pacers[i].events && (ev = xcb_poll_for_special_event(xc, pacers[i].events))) {
+            if (((xcb_present_generic_event_t *)ev)->evtype == XCB_PRESENT_COMPLETE_NOTIFY
+                && ((xcb_present_complete_notify_event_t *)ev)->kind == XCB_PRESENT_COMPLETE_KIND_NOTIFY_MSC)
+                pacers[i].due = 1;
+            free(ev);
+        }
+        ready |= pacers[i].due;
+    }
+    return ready;
+}
+
+/* Returns the next monitor due and forgets its request, or -1. */
+int pace_next() {
+    int i;
+
+    pace_ready();
+    for (i = 0; i < NPACERS; i++)
+        if (pacers[i].due) {
+            pacers[i].due = pacers[i].requested = 0;
+            return i;
+        }
+    return -1;
+}
+
+/* Makes every monitor waiting for the timer due. */
+void pace_timer(int fd) {
+    uint64_t ticks;
+    int i;
+
+    if (read(fd, &ticks, sizeof ticks) != sizeof ticks) return;
+    for (i = 0; i < NPACERS; i++)
+        if (pacers[i].requested) pacers[i].due = 1;
+}
@@ -0,0 +1,9 @@
+/* See LICENSE file for copyright and license details. */
+
+/* Layout commits paced to vblank, see pace.c */
+int pace_init(xcb_connection_t *c, Window root, int *fd);
+void pace_cleanup();
+int pace_request(int id, int x, int y);
+int pace_ready();
+int pace_next();
+void pace_timer(int fd);
@@ -0,0 +1,114 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * A small pool of threads running the iterations of a loop in parallel.
+ * The calling thread takes iterations as well and pool_for() returns once
+ * all of them are done, so callers need no locking of their own as long as
+ * iterations don't share what they write. */
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+
+#include "pool.h"
+#include "util.h"
+
+struct Pool {
+    pthread_t *threads;
+    int nthreads;
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    void (*func)(size_t i, void *arg);
+    void *arg;
+    size_t n, next;     /* iterations, next one to take */
+    int active;         /* workers still on the current loop */
+    unsigned long loop; /* bumped by every pool_for() */
+    int quit;
+};
+
+/* Takes iterations until none are left. */
+static void drain(Pool *p) {
+    size_t i;
+
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        i = p->next < p->n ? p->next++ : p->n;
+        pthread_mutex_unlock(&p->lock);
+        if (i == p->n) return;
+        p->func(i, p->arg);
+    }
+}
+
+static void *worker(void *arg) {
+    Pool *p = arg;
+    unsigned long seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        while (p->loop == seen && !p->quit) pthread_cond_wait(&p->work, &p->lock);
+        if (p->quit) {
+            pthread_mutex_unlock(&p->lock);
+            return NULL;
+        }
+        seen = p->loop;
+        pthread_mutex_unlock(&p->lock);
+        drain(p);
+        pthread_mutex_lock(&p->lock);
+        if (--p->active == 0) pthread_cond_signal(&p->done);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+/* Starts nthreads workers besides the calling thread. Signals stay with the
+ * calling thread. */
+Pool *pool_create(int nthreads) {
+    Pool *p = ecalloc(1, sizeof(Pool));
+    sigset_t all, old;
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+    p->threads = ecalloc(MAX(nthreads, 1), sizeof(pthread_t));
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (; p->nthreads < nthreads; p->nthreads++)
+        if (pthread_create(&p->threads[p->nthreads], NULL, worker, p) != 0) break;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return p;
+}
+
+void pool_free(Pool *p) {
+    int i;
+
+    pthread_mutex_lock(&p->lock);
+    p->quit = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    for (i = 0; i < p->nthreads; i++) pthread_join(p->threads[i], NULL);
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->work);
+    pthread_mutex_destroy(&p->lock);
+    free(p->threads);
+    free(p);
+}
+
+/* Calls func(i, arg) for every i below n and returns when all calls did. */
+void pool_for(Pool *p, size_t n, void (*func)(size_t i, void *arg), void *arg) {
+    size_t i;
+
+    if (n < 2 || !p->nthreads) {
+        for (i = 0; i < n; i++) func(i, arg);
+        return;
+    }
+    pthread_mutex_lock(&p->lock);
+    p->func = func;
+    p->arg = arg;
+    p->n = n;
+    p->next = 0;
+    p->active = p->nthreads;
+    p->loop++;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    drain(p);
+    pthread_mutex_lock(&p->lock);
+    while (p->active) pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
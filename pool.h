@@ -0,0 +1,7 @@
+/* See LICENSE file for copyright and license details. */
+
+typedef struct Pool Pool; /* threads running loop iterations */
+
+Pool *pool_create(int nthreads);
+void pool_free(Pool *p);
+void pool_for(Pool *p, size_t n, void (*func)(size_t i, void *arg), void *arg);
@@ -0,0 +1,150 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * A thread reading the X connection, so the server never waits for dwm
+ * to read while it's busy. Events are moved from Xlib's queue into a
+ * single producer, single consumer ring with the time they were read; run()
+ * takes them in batches. Both sides move events only while holding the
+ * display lock, so everything the reader took out of Xlib's queue is in the
+ * ring by the time run() looks at either. Loops reading events through Xlib
+ * themselves pause the reader, which puts the ring back into Xlib's queue. */
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+
+#include "reader.h"
+#include "util.h"
+
+#define RINGSIZE 1024 /* power of two */
+
+static Display *dpy;
+static pthread_t thread;
+static int wakefd = -1; /* run() polls it */
+static int stopfd = -1;
+static atomic_int paused; /* pauses nest */
+static XEvent ring[RINGSIZE];
+static long long stamps[RINGSIZE];
+static atomic_size_t head, tail; /* read by run(), written by the reader */
+
+static long long now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void *reader(void *arg) {
+    struct pollfd pfd[2] = {{ConnectionNumber(dpy), POLLIN, 0}, {stopfd, POLLIN, 0}};
+    size_t t;
+    uint64_t one = 1;
+
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) continue;
+        if (pfd[1].revents) return NULL;
+        XLockDisplay(dpy);
+        /* reading empties the socket even when the ring or the reader is
+         * full or paused, the events then wait in Xlib's queue */
+        XEventsQueued(dpy, QueuedAfterReading);
+        while (!atomic_load(&paused) && XEventsQueued(dpy, QueuedAlready)) {
+            t = atomic_load_explicit(&tail, memory_order_relaxed);
+            if (t - atomic_load_explicit(&head, memory_order_acquire) == RINGSIZE) break;
+            XNextEvent(dpy, &ring[t % RINGSIZE]);
+            stamps[t % RINGSIZE] = now();
+            atomic_store_explicit(&tail, t + 1, memory_order_release);
+        }
+        XUnlockDisplay(dpy);
+        /* even without events, replies and events XCB keeps to itself
+         * arrived that run() would never learn of otherwise */
+        if (write(wakefd, &one, sizeof one) < 0) perror("dwm: reader");
+    }
+}
+
+/* Returns the descriptor that becomes readable with events to take, or -1
+ * if the reader couldn't start. XInitThreads() must have been called. */
+int reader_start(Display *d) {
+    sigset_t all, old;
+
+    dpy = d;
+    if ((wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 || (stopfd = eventfd(0, EFD_CLOEXEC)) < 0) {
+        reader_stop();
+        return -1;
+    }
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    if (pthread_create(&thread, NULL, reader, NULL) != 0) {
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        close(stopfd);
+        stopfd = -1;
+        reader_stop();
+        return -1;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return wakefd;
+}
+
+void reader_stop() {
+    uint64_t one = 1;
+
+    if (stopfd >= 0) {
+        if (write(stopfd, &one, sizeof one) == sizeof one) pthread_join(thread, NULL);
+        close(stopfd);
+    }
+    if (wakefd >= 0) close(wakefd);
+    stopfd = wakefd = -1;
+}
+
+/* Hands the events in the ring back to Xlib until reader_resume(). */
+void reader_pause() {
+    size_t h, t;
+
+    if (wakefd < 0) return;
+    atomic_fetch_add(&paused, 1);
+    XLockDisplay(dpy);
+    /* the reader checks paused under the lock, the tail stays put now */
+    h = atomic_load_explicit(&head, memory_order_relaxed);
+    t = atomic_load_explicit(&tail, memory_order_acquire);
+    /* newest first, so they end up in order ahead of the rest */
+    while (t != h) XPutBackEvent(dpy, &ring[--t % RINGSIZE]);
+    atomic_store_explicit(&head, atomic_load(&tail), memory_order_release);
+    XUnlockDisplay(dpy);
+}
+
+void reader_resume() {
+    if (wakefd >= 0) atomic_fetch_sub(&paused, 1);
+}
+
+/* Takes up to max events with the time in microseconds they were read,
+ * those Xlib still queues after the ring. Returns how many. */
+size_t reader_take(XEvent *evs, long long *when, size_t max) {
+    size_t h, t, n = 0;
+    uint64_t count;
+
+    /* clears the wakeup, fails harmlessly if there was none */
+    (void)!read(wakefd, &count, sizeof count);
+    XLockDisplay(dpy);
+    h = atomic_load_explicit(&head, memory_order_relaxed);
+    t = atomic_load_explicit(&tail, memory_order_acquire);
+    for (; h != t && n < max; h++, n++) {
+        evs[n] = ring[h % RINGSIZE];
+        when[n] = stamps[h % RINGSIZE];
+    }
+    atomic_store_explicit(&head, h, memory_order_release);
+    /* read by Xlib on the main thread, during a round trip for example */
+    for (; h == t && n < max && XEventsQueued(dpy, QueuedAlready); n++) {
+        XNextEvent(dpy, &evs[n]);
+        when[n] = now();
+    }
+    XUnlockDisplay(dpy);
+    return n;
+}
+
+long long reader_now() { return now(); }
+
+/* Returns whether the ring holds events. */
+int reader_pending() { return atomic_load(&tail) != atomic_load(&head); }
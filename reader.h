@@ -0,0 +1,10 @@
+/* See LICENSE file for copyright and license details. */
+
+/* A thread reading X events into a ring, see reader.c */
+int reader_start(Display *d);
+void reader_stop();
+void reader_pause();
+void reader_resume();
+size_t reader_take(XEvent *evs, long long *when, size_t max);
+long long reader_now();
+int reader_pending();
@@ -0,0 +1,114 @@
+/* See LICENSE file for copyright and license details. */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "status.h"
+
+/* Reads the whole of path through the cached descriptor *fd, opening it on
+ * first use. /proc and /sys regenerate their contents on every pread(2)
+ * at offset zero, so the file never has to be reopened. */
+static int readfile(int *fd, const char *path, char *buf, size_t len) {
+    ssize_t n;
+
+    if (*fd < 0 && (*fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+    if ((n = pread(*fd, buf, len - 1, 0)) < 0) {
+        close(*fd);
+        *fd = -1;
+        return -1;
+    }
+    buf[n] = '\0';
+    return 0;
+}
+
+static unsigned long long now_ms() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void human(char *buf, size_t len, double bytes) {
+    const char *units = "BKMGT";
+
+    while (bytes >= 1024 && units[1]) {
+        bytes /= 1024;
+        units++;
+    }
+    snprintf(buf, len, "%.1f%c", bytes, *units);
+}
+
+int status_battery(char *buf, size_t len, const char *name, ModState *st) {
+    char path[128], val[16];
+
+    snprintf(path, sizeof path, "/sys/class/power_supply/%s/capacity", name);
+    if (readfile(&st->fd[0], path, val, sizeof val) < 0) return -1;
+    snprintf(buf, len, "bat %d%%", atoi(val));
+    return 0;
+}
+
+int status_clock(char *buf, size_t len, const char *fmt, ModState *st) {
+    time_t t = time(NULL);
+    struct tm tm;
+
+    (void)st;
+    if (!localtime_r(&t, &tm) || !strftime(buf, len, fmt, &tm)) return -1;
+    return 0;
+}
+
+int status_cpu(char *buf, size_t len, const char *arg, ModState *st) {
+    char stat[256];
+    unsigned long long v[8] = {0}, total = 0, idle, dt;
+    int i;
+
+    (void)arg;
+    if (readfile(&st->fd[0], "/proc/stat", stat, sizeof stat) < 0) return -1;
+    /* cpu user nice system idle iowait irq softirq steal */
+    if (sscanf(stat, "cpu %llu %llu %llu %llu %llu %llu %llu %llu", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) < 4)
+        return -1;
+    for (i = 0; i < 8; i++) total += v[i];
+    idle = v[3] + v[4];
+    dt = total - st->prev[0];
+    snprintf(buf, len, "cpu %llu%%", dt ? 100 * (dt - (idle - st->prev[1])) / dt : 0);
+    st->prev[0] = total;
+    st->prev[1] = idle;
+    return 0;
+}
+
+int status_mem(char *buf, size_t len, const char *arg, ModState *st) {
+    char info[512], *p;
+    unsigned long long total, avail;
+
+    (void)arg;
+    if (readfile(&st->fd[0], "/proc/meminfo", info, sizeof info) < 0) return -1;
+    if (!(p = strstr(info, "MemTotal:")) || sscanf(p, "MemTotal: %llu", &total) != 1 || !total) return -1;
+    if (!(p = strstr(info, "MemAvailable:")) || sscanf(p, "MemAvailable: %llu", &avail) != 1) return -1;
+    snprintf(buf, len, "mem %llu%%", 100 * (total - avail) / total);
+    return 0;
+}
+
+int status_net(char *buf, size_t len, const char *iface, ModState *st) {
+    char path[128], val[32], rx[16], tx[16];
+    unsigned long long r, t, now = now_ms(), dt = now - st->prev[2];
+
+    snprintf(path, sizeof path, "/sys/class/net/%s/statistics/rx_bytes", iface);
+    if (readfile(&st->fd[0], path, val, sizeof val) < 0) return -1;
+    r = strtoull(val, NULL, 10);
+    snprintf(path, sizeof path, "/sys/class/net/%s/statistics/tx_bytes", iface);
+    if (readfile(&st->fd[1], path, val, sizeof val) < 0) return -1;
+    t = strtoull(val, NULL, 10);
+    if (st->prev[2] && dt) {
+        human(rx, sizeof rx, (r - st->prev[0]) * 1000.0 / dt);
+        human(tx, sizeof tx, (t - st->prev[1]) * 1000.0 / dt);
+        snprintf(buf, len, "%s %s/s %s/s", iface, rx, tx);
+    } else {
+        snprintf(buf, len, "%s", iface);
+    }
+    st->prev[0] = r;
+    st->prev[1] = t;
+    st->prev[2] = now;
+    return 0;
+}
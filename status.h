@@ -0,0 +1,20 @@
+/* See LICENSE file for copyright and license details. */
+
+typedef struct {
+    int fd[2];                  /* kept open and read with pread(2) */
+    unsigned long long prev[3]; /* counters of the previous run */
+} ModState;
+
+typedef struct {
+    const char *id; /* status segment the module writes */
+    int (*func)(char *buf, size_t len, const char *arg, ModState *st);
+    const char *arg;
+    unsigned int interval; /* seconds */
+} StatusModule;
+
+/* Status modules, all return 0 and fill buf or return -1 */
+int status_battery(char *buf, size_t len, const char *name, ModState *st);
+int status_clock(char *buf, size_t len, const char *fmt, ModState *st);
+int status_cpu(char *buf, size_t len, const char *arg, ModState *st);
+int status_mem(char *buf, size_t len, const char *arg, ModState *st);
+int status_net(char *buf, size_t len, const char *iface, ModState *st);
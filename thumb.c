@@ -0,0 +1,240 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Thumbnails of clients for the overview. Clients are redirected
+ * automatically, so windows on hidden tags keep their contents, and each
+ * thumbnail is scaled once with XRender and cached. The damage of a
+ * thumbnail is only subtracted when it is rescaled, so a window that keeps
+ * drawing costs a single DamageNotify while the overview is closed. Memory
+ * is bounded by a byte budget, the least recently used thumbnails go first. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xrender.h>
+
+#include "thumb.h"
+#include "util.h"
+
+#define NSPANS 16
+
+typedef struct Thumb Thumb;
+struct Thumb {
+    Window win;
+    unsigned int maxw, maxh; /* box it was scaled into */
+    unsigned int w, h;
+    int dirty;
+    Pixmap pixmap;
+    Picture picture;
+    Damage damage;
+    Thumb *prev, *next; /* most recently used first */
+};
+
+static Display *dpy;
+static Thumb *head, *tail;
+static size_t used, budget; /* bytes */
+static int damageevent;
+static int damageerror, rendererror; /* first error codes */
+static struct {
+    unsigned long from, to;
+} spans[NSPANS]; /* requests of ours errors may still arrive for */
+static int nspans, depth;
+static unsigned long spanfrom;
+static XRenderPictFormat *argb;
+
+/* Brackets the requests of an entry point, as in comp.c. */
+static void begin() {
+    if (!depth++) spanfrom = NextRequest(dpy);
+}
+
+static void end() {
+    unsigned long seen = LastKnownRequestProcessed(dpy), next = NextRequest(dpy);
+    int i, j;
+
+    if (--depth) return;
+    for (i = j = 0; i < nspans; i++)
+        if (spans[i].to > seen + 1) spans[j++] = spans[i];
+    nspans = j;
+    if (next == spanfrom) return;
+    if (nspans && spans[nspans - 1].to == spanfrom) {
+        spans[nspans - 1].to = next;
+        return;
+    }
+    if (nspans == NSPANS) {
+        spans[1].from = spans[0].from;
+        memmove(spans, spans + 1, --nspans * sizeof *spans);
+    }
+    spans[nspans].from = spanfrom;
+    spans[nspans++].to = next;
+}
+
+static void attach(Thumb *t) {
+    t->prev = NULL;
+    t->next = head;
+    if (head) head->prev = t;
+    head = t;
+    if (!tail) tail = t;
+}
+
+static void detach(Thumb *t) {
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        head = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+    else
+        tail = t->prev;
+}
+
+static Thumb *findthumb(Window win) {
+    Thumb *t;
+
+    for (t = head; t && t->win != win; t = t->next)
+        ;
+    return t;
+}
+
+static void freepixmap(Thumb *t) {
+    if (!t->pixmap) return;
+    XRenderFreePicture(dpy, t->picture);
+    XFreePixmap(dpy, t->pixmap);
+    used -= (size_t)t->w * t->h * 4;
+    t->picture = None;
+    t->pixmap = None;
+}
+
+static void freethumb(Thumb *t, int destroyed) {
+    detach(t);
+    freepixmap(t);
+    /* the server frees the damage of destroyed windows itself */
+    if (!destroyed) XDamageDestroy(dpy, t->damage);
+    free(t);
+}
+
+int thumb_init(Display *d, size_t b) {
+    int op, ev, err, major = 0, minor = 2;
+
+    dpy = d;
+    budget = b;
+    if (!XQueryExtension(dpy, COMPOSITE_NAME, &op, &ev, &err) || !XCompositeQueryVersion(dpy, &major, &minor)
+        || (major == 0 && minor < 2) || !XQueryExtension(dpy, "DAMAGE", &op, &ev, &damageerror)
+        || !XQueryExtension(dpy, RENDER_NAME, &op, &ev, &rendererror)) {
+        fprintf(stderr, "dwm: Composite 0.2, Damage and Render are needed for the overview\n");
+        return -1;
+    }
+    XDamageQueryExtension(dpy, &damageevent, &damageerror);
+    argb = XRenderFindStandardFormat(dpy, PictStandardARGB32);
+    return 0;
+}
+
+void thumb_cleanup() {
+    begin();
+    while (head) freethumb(head, 0);
+    end();
+}
+
+int thumb_event(XEvent *ev) {
+    Thumb *t;
+
+    if (ev->type != damageevent + XDamageNotify) return 0;
+    for (t = head; t && t->damage != ((XDamageNotifyEvent *)ev)->damage; t = t->next)
+        ;
+    if (!t) return 0;
+    t->dirty = 1; /* rescaled and subtracted by the next thumb_get() */
+    return 1;
+}
+
+void thumb_forget(Window win, int destroyed) {
+    Thumb *t = findthumb(win);
+
+    begin();
+    if (t) freethumb(t, destroyed);
+    if (!destroyed) XCompositeUnredirectWindow(dpy, win, CompositeRedirectAutomatic);
+    end();
+}
+
+/* Returns the thumbnail of win scaled to fit maxw x maxh and stores its
+ * size in w and h, or None. */
+Picture thumb_get(Window win, unsigned int maxw, unsigned int maxh, unsigned int *w, unsigned int *h) {
+    XWindowAttributes wa;
+    XRenderPictFormat *fmt;
+    XRenderPictureAttributes pa = {.subwindow_mode = IncludeInferiors};
+    XTransform xf = {{{0}}};
+    Pixmap pm;
+    Picture src;
+    Thumb *t = findthumb(win);
+    double scale;
+    unsigned int ww, wh, tw, th;
+
+    if (t && !t->dirty && t->maxw == maxw && t->maxh == maxh) {
+        detach(t);
+        attach(t);
+        *w = t->w;
+        *h = t->h;
+        return t->picture;
+    }
+    if (!XGetWindowAttributes(dpy, win, &wa) || !(fmt = XRenderFindVisualFormat(dpy, wa.visual))) return None;
+    ww = wa.width + 2 * wa.border_width;
+    wh = wa.height + 2 * wa.border_width;
+    scale = MIN(1.0, MIN((double)maxw / ww, (double)maxh / wh));
+    tw = MAX(1, ww * scale);
+    th = MAX(1, wh * scale);
+    begin();
+    if (!t) {
+        t = ecalloc(1, sizeof(Thumb));
+        t->win = win;
+        t->damage = XDamageCreate(dpy, win, XDamageReportNonEmpty);
+    } else
+        detach(t);
+    attach(t);
+    if (t->w != tw || t->h != th) freepixmap(t);
+    if (!t->pixmap) {
+        t->pixmap = XCreatePixmap(dpy, DefaultRootWindow(dpy), tw, th, 32);
+        t->picture = XRenderCreatePicture(dpy, t->pixmap, argb, 0, NULL);
+        used += (size_t)tw * th * 4;
+    }
+    t->maxw = maxw;
+    t->maxh = maxh;
+    t->w = tw;
+    t->h = th;
+    t->dirty = 0;
+    /* subtract first, drawing from now on reports again */
+    XDamageSubtract(dpy, t->damage, None, None);
+    pm = XCompositeNameWindowPixmap(dpy, win);
+    src = XRenderCreatePicture(dpy, pm, fmt, CPSubwindowMode, &pa);
+    xf.matrix[0][0] = xf.matrix[1][1] = XDoubleToFixed(1.0 / scale);
+    xf.matrix[2][2] = XDoubleToFixed(1.0);
+    XRenderSetPictureTransform(dpy, src, &xf);
+    XRenderSetPictureFilter(dpy, src, FilterBilinear, NULL, 0);
+    XRenderComposite(dpy, PictOpSrc, src, None, t->picture, 0, 0, 0, 0, 0, 0, tw, th);
+    XRenderFreePicture(dpy, src);
+    XFreePixmap(dpy, pm);
+    while (used > budget && tail != t) freethumb(tail, 0);
+    end();
+    *w = tw;
+    *h = th;
+    return t->picture;
+}
+
+/* Naming the pixmap of a window that vanished or was unredirected fails,
+ * the thumbnail just stays stale. Only errors of our own requests on what
+ * vanished are ignored. */
+int thumb_ignoreerror(XErrorEvent *ee) {
+    int i, ours = depth && ee->serial >= spanfrom;
+
+    for (i = 0; i < nspans && !ours; i++) ours = ee->serial >= spans[i].from && ee->serial < spans[i].to;
+    return ours
+           && (ee->error_code == BadWindow || ee->error_code == BadDrawable || ee->error_code == BadPixmap || ee->error_code == BadMatch
+               || ee->error_code == damageerror + BadDamage || ee->error_code == rendererror + BadPicture);
+}
+
+void thumb_redirect(Window win, int redirect) {
+    begin();
+    if (redirect)
+        XCompositeRedirectWindow(dpy, win, CompositeRedirectAutomatic);
+    else
+        XCompositeUnredirectWindow(dpy, win, CompositeRedirectAutomatic);
+    end();
+}
@@ -0,0 +1,10 @@
+/* See LICENSE file for copyright and license details. */
+
+/* Thumbnail cache for the overview, only compiled with -DOVERVIEW */
+int thumb_init(Display *dpy, size_t budget);
+void thumb_cleanup();
+int thumb_event(XEvent *ev);
+void thumb_forget(Window win, int destroyed);
+Picture thumb_get(Window win, unsigned int maxw, unsigned int maxh, unsigned int *w, unsigned int *h);
+int thumb_ignoreerror(XErrorEvent *ee);
+void thumb_redirect(Window win, int redirect);
@@ -0,0 +1,153 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Incremental trigram index. Every id owns one lowercased text and every
+ * trigram maps to a bitset of the ids whose text contains it. Changing a
+ * text flips one bit per trigram, a query ANDs the bitsets of the trigrams
+ * of its terms and only checks the candidates left with strstr(3). */
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trigram.h"
+#include "util.h"
+
+#define BUCKETS_BITS 12
+#define TERMS 8 /* query terms looked at */
+
+typedef struct Posting Posting;
+struct Posting {
+    uint32_t tri;
+    uint64_t *bits; /* ids containing tri */
+    Posting *next;
+};
+
+struct TriIndex {
+    Posting *buckets[1 << BUCKETS_BITS];
+    char **text;  /* by id, NULL if unset */
+    size_t words; /* ids fit in words * 64 bits */
+};
+
+static uint32_t trigram(const char *s) { return (uint32_t)(unsigned char)s[0] << 16 | (unsigned char)s[1] << 8 | (unsigned char)s[2]; }
+
+/* Returns the link to the posting of tri, or to the end of its chain. */
+static Posting **slot(TriIndex *ti, uint32_t tri) {
+    Posting **pp = &ti->buckets[(tri * 2654435761u) >> (32 - BUCKETS_BITS)];
+
+    while (*pp && (*pp)->tri != tri) pp = &(*pp)->next;
+    return pp;
+}
+
+static Posting *posting(TriIndex *ti, uint32_t tri, int create) {
+    Posting **pp = slot(ti, tri), *p = *pp;
+
+    if (p || !create) return p;
+    p = ecalloc(1, sizeof(Posting));
+    p->tri = tri;
+    p->bits = ecalloc(ti->words, sizeof(uint64_t));
+    *pp = p;
+    return p;
+}
+
+static void grow(TriIndex *ti, size_t words) {
+    Posting *p;
+    size_t i;
+
+    if (!(ti->text = realloc(ti->text, words * 64 * sizeof(char *)))) die("realloc:");
+    memset(ti->text + ti->words * 64, 0, (words - ti->words) * 64 * sizeof(char *));
+    for (i = 0; i < (1 << BUCKETS_BITS); i++)
+        for (p = ti->buckets[i]; p; p = p->next) {
+            if (!(p->bits = realloc(p->bits, words * sizeof(uint64_t)))) die("realloc:");
+            memset(p->bits + ti->words, 0, (words - ti->words) * sizeof(uint64_t));
+        }
+    ti->words = words;
+}
+
+static void mark(TriIndex *ti, unsigned int id, int set) {
+    const char *s = ti->text[id];
+    Posting **pp, *p;
+    size_t i;
+
+    for (; s[0] && s[1] && s[2]; s++) {
+        if (set) {
+            posting(ti, trigram(s), 1)->bits[id / 64] |= 1ULL << id % 64;
+            continue;
+        }
+        if (!(p = *(pp = slot(ti, trigram(s))))) continue;
+        p->bits[id / 64] &= ~(1ULL << id % 64);
+        /* titles keep changing, trigrams no text has any more must go */
+        for (i = 0; i < ti->words && !p->bits[i]; i++)
+            ;
+        if (i < ti->words) continue;
+        *pp = p->next;
+        free(p->bits);
+        free(p);
+    }
+}
+
+TriIndex *tri_create() { return ecalloc(1, sizeof(TriIndex)); }
+
+void tri_free(TriIndex *ti) {
+    Posting *p;
+    size_t i;
+
+    for (i = 0; i < (1 << BUCKETS_BITS); i++)
+        while ((p = ti->buckets[i])) {
+            ti->buckets[i] = p->next;
+            free(p->bits);
+            free(p);
+        }
+    for (i = 0; i < ti->words * 64; i++) free(ti->text[i]);
+    free(ti->text);
+    free(ti);
+}
+
+/* Stores the ids whose text contains every space separated term of query,
+ * ignoring case, in ids in ascending order and returns how many. */
+size_t tri_query(TriIndex *ti, const char *query, unsigned int *ids, size_t max) {
+    char buf[256], *term[TERMS], *s;
+    uint64_t *cand, word;
+    Posting *p;
+    size_t i, n = 0;
+    unsigned int id;
+    int t, nterms = 0;
+
+    if (!ti->words) return 0;
+    for (i = 0; query[i] && i < sizeof buf - 1; i++) buf[i] = tolower((unsigned char)query[i]);
+    buf[i] = '\0';
+    for (s = strtok(buf, " "); s && nterms < TERMS; s = strtok(NULL, " ")) term[nterms++] = s;
+
+    cand = ecalloc(ti->words, sizeof(uint64_t));
+    memset(cand, 0xff, ti->words * sizeof(uint64_t));
+    for (t = 0; t < nterms; t++)
+        for (s = term[t]; s[0] && s[1] && s[2]; s++)
+            for (i = 0, p = posting(ti, trigram(s), 0); i < ti->words; i++) cand[i] &= p ? p->bits[i] : 0;
+    for (i = 0; i < ti->words && n < max; i++)
+        for (word = cand[i]; word && n < max; word &= word - 1) {
+            id = i * 64 + __builtin_ctzll(word);
+            if (!ti->text[id]) continue;
+            /* trigrams don't see order or terms shorter than three */
+            for (t = 0; t < nterms && strstr(ti->text[id], term[t]); t++)
+                ;
+            if (t == nterms) ids[n++] = id;
+        }
+    free(cand);
+    return n;
+}
+
+/* Replaces the text of id, NULL removes it. */
+void tri_set(TriIndex *ti, unsigned int id, const char *text) {
+    size_t i, len;
+
+    if (id >= ti->words * 64) grow(ti, id / 64 + 1);
+    if (ti->text[id]) {
+        mark(ti, id, 0);
+        free(ti->text[id]);
+        ti->text[id] = NULL;
+    }
+    if (!text) return;
+    len = strlen(text);
+    ti->text[id] = ecalloc(len + 1, 1);
+    for (i = 0; i < len; i++) ti->text[id][i] = tolower((unsigned char)text[i]);
+    mark(ti, id, 1);
+}
@@ -0,0 +1,8 @@
+/* See LICENSE file for copyright and license details. */
+
+typedef struct TriIndex TriIndex; /* trigram index over short texts */
+
+TriIndex *tri_create();
+void tri_free(TriIndex *ti);
+size_t tri_query(TriIndex *ti, const char *query, unsigned int *ids, size_t max);
+void tri_set(TriIndex *ti, unsigned int id, const char *text);
@@ -7,7 +7,7 @@
 #ifdef _DEBUG
 #define DEBUG(...) fprintf(stderr, __VA_ARGS__)
 #else
-#define DEBUG(...)
+#define DEBUG(...) do {} while (0)
 #endif
 
 void die(const char *fmt, ...);
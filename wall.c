@@ -0,0 +1,269 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * The root background. The image is scaled onto every monitor of a single
+ * root pixmap, which is published through _XROOTPMAP_ID for compositors and
+ * pseudo-transparent clients. It isn't published as ESETROOT_PMAP_ID: the
+ * next setter would XKillClient() it, and with it dwm's connection. The
+ * scaled pixels are cached on disk under a key of the image and the monitor
+ * layout, so logins and known hotplug layouts don't decode the image at all;
+ * once decoded, it's kept for the layouts that aren't cached yet. Only the
+ * most recently used layouts stay cached. */
+#include <glob.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <utime.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <Imlib2.h>
+
+#include "util.h"
+#include "wall.h"
+
+#define MAGIC "dwmwall1"
+#define KEEP 8 /* cached layouts */
+
+typedef struct {
+    char magic[8];
+    uint32_t w, h, depth, bpl; /* of the ZPixmap image following */
+} CacheHeader;
+
+typedef struct {
+    time_t used;
+    const char *path;
+} Cached;
+
+static Display *dpy;
+static int screen;
+static Window root;
+static char *image;     /* path of the image */
+static char *cachebase; /* cache files are cachebase-<key> */
+static Imlib_Image decoded;
+static Pixmap pixmap;
+static Atom rootpmap, esetroot;
+
+static uint64_t fnv(uint64_t h, const void *p, size_t n) {
+    const unsigned char *s = p;
+
+    while (n--) h = (h ^ *s++) * 1099511628211ull;
+    return h;
+}
+
+/* A key of everything the scaled pixels depend on. */
+static uint64_t layoutkey(const XRectangle *r, int n, int w, int h) {
+    struct stat st;
+    uint64_t k = fnv(14695981039346656037ull, image, strlen(image));
+    int32_t v[3] = {w, h, DefaultDepth(dpy, screen)};
+
+    if (stat(image, &st) == 0) {
+        k = fnv(k, &st.st_mtime, sizeof st.st_mtime);
+        k = fnv(k, &st.st_size, sizeof st.st_size);
+    }
+    k = fnv(k, v, sizeof v);
+    return fnv(k, r, n * sizeof(XRectangle));
+}
+
+static char *cachefile(uint64_t key) {
+    char *path;
+
+    if (!cachebase) return NULL;
+    path = ecalloc(strlen(cachebase) + 18, 1);
+    sprintf(path, "%s-%016llx", cachebase, (unsigned long long)key);
+    return path;
+}
+
+static int newer(const void *a, const void *b) {
+    time_t x = ((const Cached *)a)->used, y = ((const Cached *)b)->used;
+
+    return (y > x) - (y < x);
+}
+
+/* Removes all but the KEEP cache files used last. */
+static void evict() {
+    glob_t g;
+    struct stat st;
+    Cached *c;
+    char *pattern;
+    size_t i;
+
+    if (!cachebase) return;
+    pattern = ecalloc(strlen(cachebase) + 3, 1);
+    sprintf(pattern, "%s-*", cachebase);
+    if (glob(pattern, GLOB_NOSORT, NULL, &g) == 0) {
+        c = ecalloc(g.gl_pathc, sizeof(Cached));
+        for (i = 0; i < g.gl_pathc; i++) {
+            c[i].path = g.gl_pathv[i];
+            c[i].used = stat(c[i].path, &st) == 0 ? st.st_mtime : 0;
+        }
+        qsort(c, g.gl_pathc, sizeof(Cached), newer);
+        for (i = KEEP; i < g.gl_pathc; i++) remove(c[i].path);
+        free(c);
+        globfree(&g);
+    }
+    free(pattern);
+}
+
+static int loadcache(const char *path, Pixmap pm, int w, int h) {
+    FILE *f;
+    CacheHeader hd;
+    XImage *img;
+    char *data;
+    GC gc;
+
+    if (!path || !(f = fopen(path, "r"))) return -1;
+    if (fread(&hd, sizeof hd, 1, f) != 1 || memcmp(hd.magic, MAGIC, sizeof hd.magic) || hd.w != (uint32_t)w
+        || hd.h != (uint32_t)h || hd.depth != (uint32_t)DefaultDepth(dpy, screen)) {
+        fclose(f);
+        return -1;
+    }
+    data = ecalloc(hd.h, hd.bpl);
+    if (fread(data, hd.bpl, hd.h, f) != hd.h) {
+        free(data);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    utime(path, NULL); /* used, see evict() */
+    img = XCreateImage(dpy, DefaultVisual(dpy, screen), hd.depth, ZPixmap, 0, data, w, h, 32, hd.bpl);
+    gc = XCreateGC(dpy, pm, 0, NULL);
+    XPutImage(dpy, pm, gc, img, 0, 0, 0, 0, w, h);
+    XFreeGC(dpy, gc);
+    XDestroyImage(img); /* frees data */
+    return 0;
+}
+
+static void savecache(const char *path, Pixmap pm, int w, int h) {
+    FILE *f;
+    CacheHeader hd = {MAGIC, w, h, DefaultDepth(dpy, screen), 0};
+    XImage *img;
+    char *tmp;
+
+    if (!path || !(img = XGetImage(dpy, pm, 0, 0, w, h, AllPlanes, ZPixmap))) return;
+    hd.bpl = img->bytes_per_line;
+    tmp = ecalloc(strlen(path) + 5, 1);
+    sprintf(tmp, "%s.tmp", path);
+    if ((f = fopen(tmp, "w"))) {
+        fwrite(&hd, sizeof hd, 1, f);
+        fwrite(img->data, hd.bpl, h, f);
+        if (fclose(f) == 0) rename(tmp, path);
+    }
+    free(tmp);
+    XDestroyImage(img);
+}
+
+/* Scales the image onto every monitor, like feh --bg-scale. */
+static int render(Pixmap pm, const XRectangle *r, int n) {
+    int i;
+
+    if (!decoded && !(decoded = imlib_load_image(image))) {
+        fprintf(stderr, "dwm: cannot load wallpaper %s\n", image);
+        return -1;
+    }
+    imlib_context_set_image(decoded);
+    imlib_context_set_drawable(pm);
+    for (i = 0; i < n; i++) imlib_render_image_on_drawable_at_size(r[i].x, r[i].y, r[i].width, r[i].height);
+    return 0;
+}
+
+static Pixmap getpixmap(Atom prop) {
+    Atom type;
+    int format;
+    unsigned long n, extra;
+    unsigned char *p = NULL;
+    Pixmap pm = None;
+
+    if (XGetWindowProperty(dpy, root, prop, 0, 1, False, XA_PIXMAP, &type, &format, &n, &extra, &p) == Success
+        && type == XA_PIXMAP && n == 1)
+        pm = *(Pixmap *)p;
+    if (p) XFree(p);
+    return pm;
+}
+
+/* Frees the pixmap another setter kept alive after exiting, as Esetroot
+ * does, and drops its id. A stale id fails with BadValue, which dwm
+ * ignores. */
+static void killprevious() {
+    Pixmap old = getpixmap(esetroot);
+
+    if (!old) return;
+    if (old != pixmap && old == getpixmap(rootpmap)) XKillClient(dpy, old);
+    XDeleteProperty(dpy, root, esetroot);
+}
+
+/* Finds the image matching pattern, a glob(7) that may start with ~.
+ * Returns -1 if there's none. */
+int wall_init(Display *d, int s, const char *pattern, const char *cache) {
+    glob_t g;
+
+    dpy = d;
+    screen = s;
+    root = RootWindow(dpy, screen);
+    if (glob(pattern, GLOB_TILDE | GLOB_NOSORT, NULL, &g) != 0) return -1;
+    image = ecalloc(strlen(g.gl_pathv[0]) + 1, 1);
+    strcpy(image, g.gl_pathv[0]);
+    globfree(&g);
+    if (cache) {
+        cachebase = ecalloc(strlen(cache) + 1, 1);
+        strcpy(cachebase, cache);
+    }
+    rootpmap = XInternAtom(dpy, "_XROOTPMAP_ID", False);
+    esetroot = XInternAtom(dpy, "ESETROOT_PMAP_ID", False);
+    imlib_set_cache_size(0); /* the decoded image is held here */
+    imlib_context_set_display(dpy);
+    imlib_context_set_visual(DefaultVisual(dpy, screen));
+    imlib_context_set_colormap(DefaultColormap(dpy, screen));
+    return 0;
+}
+
+void wall_cleanup() {
+    if (decoded) {
+        imlib_context_set_image(decoded);
+        imlib_free_image();
+    }
+    if (pixmap) {
+        /* unless another setter took over */
+        if (getpixmap(rootpmap) == pixmap) XDeleteProperty(dpy, root, rootpmap);
+        XFreePixmap(dpy, pixmap);
+    }
+    free(image);
+    free(cachebase);
+    decoded = NULL;
+    pixmap = None;
+    image = cachebase = NULL;
+}
+
+/* Paints the n monitors r of the w x h screen. */
+void wall_paint(const XRectangle *r, int n, int w, int h) {
+    Pixmap pm;
+    char *path;
+    GC gc;
+
+    if (!image) return;
+    pm = XCreatePixmap(dpy, root, w, h, DefaultDepth(dpy, screen));
+    /* black between monitors of different sizes */
+    gc = XCreateGC(dpy, pm, 0, NULL);
+    XSetForeground(dpy, gc, BlackPixel(dpy, screen));
+    XFillRectangle(dpy, pm, gc, 0, 0, w, h);
+    XFreeGC(dpy, gc);
+    path = cachefile(layoutkey(r, n, w, h));
+    if (loadcache(path, pm, w, h) < 0) {
+        if (render(pm, r, n) < 0) {
+            XFreePixmap(dpy, pm);
+            free(path);
+            return;
+        }
+        savecache(path, pm, w, h);
+        evict();
+    }
+    free(path);
+    killprevious();
+    XChangeProperty(dpy, root, rootpmap, XA_PIXMAP, 32, PropModeReplace, (unsigned char *)&pm, 1);
+    XSetWindowBackgroundPixmap(dpy, root, pm);
+    XClearWindow(dpy, root);
+    if (pixmap) XFreePixmap(dpy, pixmap);
+    pixmap = pm;
+}
@@ -0,0 +1,6 @@
+/* See LICENSE file for copyright and license details. */
+
+/* Root background, only compiled with -DWALLPAPER */
+int wall_init(Display *dpy, int screen, const char *pattern, const char *cache);
+void wall_cleanup();
+void wall_paint(const XRectangle *r, int n, int w, int h);